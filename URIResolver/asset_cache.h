@@ -0,0 +1,194 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <pxr/base/tf/token.h>
+
+#include <pxr/usd/ar/asset.h>
+
+#include <tbb/concurrent_unordered_map.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+enum CacheState { CACHE_MISSING, CACHE_NEEDS_FETCHING, CACHE_FETCHED };
+
+// Everything we know about a single asset on a server. The state and the
+// timestamp are atomics, so they can be checked without taking any locks.
+// The asset itself is guarded by fetch_mutex, which is held while talking
+// to the server, so only one thread downloads a given asset at a time. The
+// entry only holds a weak reference to the asset, it is kept alive by its
+// users and by the AssetLru.
+struct Cache {
+    explicit Cache(const TfToken& local_path) : local_path(local_path) {}
+
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
+
+    // Changes the state only if nobody else changed it since it was read.
+    bool transition(CacheState from, CacheState to) {
+        return state.compare_exchange_strong(from, to);
+    }
+
+    // Stores what a resolve learned about a missing asset. The resolve also
+    // read the timestamp, so the next timestamp query can use it instead of
+    // asking the server again.
+    bool set_resolved(double resolved_timestamp, size_t resolved_size) {
+        if (!transition(CACHE_MISSING, CACHE_NEEDS_FETCHING)) { return false; }
+        timestamp = resolved_timestamp;
+        size = resolved_size;
+        size_timestamp = resolved_timestamp;
+        timestamp_fresh = true;
+        missing_at = 0;
+        mark_validated();
+        return true;
+    }
+
+    // Call when the server confirmed the timestamp.
+    void mark_validated() { validated_at = now(); }
+
+    // True if the server confirmed the timestamp less than window ago.
+    bool validated_within(std::chrono::steady_clock::duration window) const {
+        return window.count() > 0 && now() - validated_at < window.count();
+    }
+
+    // Call when the server confirmed that the asset does not exist.
+    void mark_missing() { missing_at = now(); }
+
+    // True if the server confirmed the asset missing less than window ago.
+    bool missing_within(std::chrono::steady_clock::duration window) const {
+        const auto since = missing_at.load();
+        return since != 0 && window.count() > 0 &&
+               now() - since < window.count();
+    }
+
+    static int64_t now() {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    const TfToken local_path;
+    std::atomic<CacheState> state{CACHE_MISSING};
+    std::atomic<double> timestamp{1.0};
+    // Size of the data on the server, as of the last resolve or fetch.
+    std::atomic<size_t> size{0};
+    // Version the size belongs to, the timestamp can move on without it.
+    std::atomic<double> size_timestamp{0.0};
+    // Set when the timestamp was just read by a resolve, cleared when used.
+    std::atomic<bool> timestamp_fresh{false};
+    // Steady clock ticks when the server last confirmed the timestamp.
+    std::atomic<int64_t> validated_at{0};
+    // Steady clock ticks when a resolve last found nothing, zero otherwise.
+    std::atomic<int64_t> missing_at{0};
+    std::mutex fetch_mutex;
+    std::weak_ptr<ArAsset> asset;
+};
+
+// Keeps the most recently used assets alive, up to a total size in bytes.
+// Assets dropped from here are freed as soon as nobody else uses them, while
+// their cache entries keep the metadata. Entries are keyed by the asset, so
+// data shared by several paths is only charged once.
+class AssetLru {
+public:
+    explicit AssetLru(size_t budget) : budget(budget) {}
+
+    AssetLru(const AssetLru&) = delete;
+    AssetLru& operator=(const AssetLru&) = delete;
+
+    // Marks the asset as the most recently used one. Replaced assets are not
+    // touched anymore, so they are the first to go.
+    void touch(std::shared_ptr<ArAsset> asset) {
+        if (asset == nullptr) { return; }
+        const auto* key = asset.get();
+        const auto size = asset->GetSize();
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = positions.find(key);
+        if (it != positions.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        entries.emplace_front(size, std::move(asset));
+        positions.emplace(key, entries.begin());
+        used += size;
+        // The asset just used is kept, even if it is larger than the budget.
+        while (used > budget && entries.size() > 1) {
+            used -= entries.back().first;
+            positions.erase(entries.back().second.get());
+            entries.pop_back();
+        }
+    }
+
+private:
+    // The size is stored, so it is charged back exactly as it was added.
+    using entry = std::pair<size_t, std::shared_ptr<ArAsset>>;
+
+    std::mutex mutex;
+    std::list<entry> entries;
+    std::unordered_map<const ArAsset*, std::list<entry>::iterator> positions;
+    size_t used = 0;
+    const size_t budget;
+};
+
+// Assets by the hash of their contents, so paths holding the same data share
+// a single buffer. Only weak references are held, like in the cache entries.
+class AssetHashIndex {
+public:
+    std::shared_ptr<ArAsset> find(const std::string& hash) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = entries.find(hash);
+        return it == entries.end() ? nullptr : it->second.lock();
+    }
+
+    void insert(
+        const std::string& hash, const std::shared_ptr<ArAsset>& asset) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[hash] = asset;
+        // Drop the freed assets every time the map doubles in size.
+        if (entries.size() >= 2 * swept_size) {
+            for (auto it = entries.begin(); it != entries.end();) {
+                it = it->second.expired() ? entries.erase(it) : std::next(it);
+            }
+            swept_size = std::max<size_t>(entries.size(), 64);
+        }
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<ArAsset>> entries;
+    size_t swept_size = 64;
+};
+
+// Concurrent map from asset paths to cache entries. Lookups and insertions
+// don't lock each other out, and entries are never removed, so the returned
+// pointers stay valid for the lifetime of the map.
+class AssetCache {
+public:
+    Cache* find(const TfToken& asset_path) const {
+        const auto it = entries.find(asset_path);
+        return it == entries.end() ? nullptr : it->second.get();
+    }
+
+    // Returns the existing entry if another thread inserted it first.
+    Cache* insert(const TfToken& asset_path, const TfToken& local_path) {
+        return entries
+            .insert({asset_path, std::make_shared<Cache>(local_path)})
+            .first->second.get();
+    }
+
+private:
+    tbb::concurrent_unordered_map<
+        TfToken, std::shared_ptr<Cache>, TfToken::HashFunctor>
+        entries;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
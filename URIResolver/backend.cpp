@@ -0,0 +1,87 @@
+#include "backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "debug_codes.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+std::string get_env_var(
+    const std::string& server_name, const std::string& env_var,
+    const std::string& default_value) {
+    const auto env_first = getenv((server_name + "_" + env_var).c_str());
+    if (env_first != nullptr) { return env_first; }
+    const auto env_second = getenv(env_var.c_str());
+    if (env_second != nullptr) { return env_second; }
+    return default_value;
+}
+
+Backend::Backend(const std::string& name, size_t max_size, Opener opener)
+    : name(name), opener(std::move(opener)), max_size(max_size) {
+    auto session = open();
+    if (session != nullptr) {
+        idle.push_back(session.get());
+        all.push_back(std::move(session));
+        valid = true;
+    }
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "Backend: up to %zu connections to %s\n", this->max_size,
+            name.c_str());
+}
+
+Backend::Handle Backend::acquire() {
+    if (!valid) { return {}; }
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    while (true) {
+        if (!idle.empty()) {
+            auto* session = idle.back();
+            idle.pop_back();
+            return {this, session};
+        }
+        if (all.size() < max_size) {
+            // Reserve the slot, so other threads don't open sessions past the
+            // limit while we are connecting.
+            all.emplace_back();
+            lock.unlock();
+            auto session = open();
+            lock.lock();
+            auto slot = std::find(all.begin(), all.end(), nullptr);
+            if (session != nullptr) {
+                *slot = std::move(session);
+                return {this, slot->get()};
+            }
+            // The storage refuses more sessions, so stop growing and share
+            // the ones we already have.
+            all.erase(slot);
+            max_size = all.size();
+            TF_DEBUG(USD_URI_SQL_RESOLVER)
+                .Msg(
+                    "Backend: limiting pool for %s to %zu connections\n",
+                    name.c_str(), max_size);
+            if (max_size == 0) { return {}; }
+            continue;
+        }
+        pool_cv.wait(lock);
+    }
+}
+
+std::unique_ptr<Backend::Session> Backend::open() {
+    auto session = opener();
+    if (session != nullptr) {
+        session->reconnects = &reconnected;
+        opened.fetch_add(1, std::memory_order_relaxed);
+    }
+    return session;
+}
+
+void Backend::release(Session* session) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        idle.push_back(session);
+    }
+    pool_cv.notify_one();
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
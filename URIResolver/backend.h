@@ -0,0 +1,206 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <pxr/base/tf/token.h>
+
+#include <pxr/usd/ar/asset.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+constexpr double INVALID_TIME = std::numeric_limits<double>::lowest();
+
+enum ResolveResult { RESOLVE_FOUND, RESOLVE_MISSING, RESOLVE_FAILED };
+
+// Reads a setting of the server. First the server specific variable is
+// queried, then the global one, then the default value is used.
+std::string get_env_var(
+    const std::string& server_name, const std::string& env_var,
+    const std::string& default_value);
+
+// Storage the assets of a server are read from, a table with a path, a data
+// and a timestamp column. SQLConnection caches what it reads, and only talks
+// to the storage through sessions.
+//
+// Sessions are opened on demand, up to the configured number, and each one is
+// used by a single thread at a time, so queries from different threads can
+// run in parallel.
+class Backend {
+public:
+    // A connection to the storage. Timestamps are in seconds, and only have to
+    // be comparable with other timestamps of the same storage.
+    class Session {
+    public:
+        virtual ~Session() = default;
+
+        // Checks if the asset exists, and reads its timestamp and size.
+        virtual ResolveResult resolve(
+            const TfToken& asset_path, double& timestamp, size_t& size) = 0;
+        // Returns INVALID_TIME if the asset is missing or the query failed.
+        virtual double get_timestamp(const TfToken& asset_path) = 0;
+        // Reads the data and its timestamp.
+        virtual std::shared_ptr<ArAsset> fetch(
+            const TfToken& asset_path, double& timestamp) = 0;
+        // Reads the data only if it is newer than since. Returns
+        // RESOLVE_MISSING if the data did not change, or if the asset was
+        // removed.
+        virtual ResolveResult fetch_if_newer(
+            const TfToken& asset_path, double since,
+            std::shared_ptr<ArAsset>& asset, double& timestamp) = 0;
+        // Reads part of the data, only if the asset was not changed since it
+        // was resolved with the given timestamp.
+        virtual bool fetch_range(
+            const TfToken& asset_path, double timestamp, size_t offset,
+            size_t size, char* buffer) = 0;
+        // Reads the content hash of the asset, and the timestamp it belongs
+        // to. Only used if a hash column is configured.
+        virtual bool hash(
+            const TfToken& asset_path, std::string& hash,
+            double& timestamp) = 0;
+
+        using ResolveCallback = std::function<void(
+            const std::string& asset_path, ResolveResult result,
+            double timestamp, size_t size)>;
+        using FetchCallback = std::function<void(
+            const std::string& asset_path,
+            const std::shared_ptr<ArAsset>& asset, double timestamp)>;
+        using HashCallback = std::function<void(
+            const std::string& asset_path, const std::string& hash,
+            double timestamp)>;
+        using ChangeCallback = std::function<void(
+            const std::string& asset_path, double timestamp)>;
+
+        // Same as resolve, fetch and hash for many assets. Paths are reported
+        // at most once, and paths of failed queries are not reported.
+        virtual void resolve_batch(
+            const std::vector<TfToken>& asset_paths,
+            const ResolveCallback& on_result) = 0;
+        virtual void fetch_batch(
+            const std::vector<TfToken>& asset_paths,
+            const FetchCallback& on_fetched) = 0;
+        virtual void hash_batch(
+            const std::vector<TfToken>& asset_paths,
+            const HashCallback& on_hash) = 0;
+
+        // Reads the timestamp of the latest change in the table into
+        // high_water, so polling for changes can start from there. An empty
+        // table leaves it unchanged.
+        virtual bool latest_change(double& high_water) = 0;
+        // Reports every row changed since high_water, and moves high_water
+        // to the latest change seen.
+        virtual bool changes(
+            double& high_water, const ChangeCallback& on_change) = 0;
+
+    protected:
+        // Call when the connection to the storage had to be reestablished.
+        void count_reconnect() {
+            if (reconnects != nullptr) {
+                reconnects->fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        friend class Backend;
+        std::atomic<uint64_t>* reconnects = nullptr;
+    };
+
+    // Gives the session back to the backend when going out of scope.
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(Backend* backend, Session* session)
+            : backend(backend), session(session) {}
+        ~Handle() { release(); }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        Handle(Handle&& other) noexcept
+            : backend(other.backend), session(other.session) {
+            other.backend = nullptr;
+            other.session = nullptr;
+        }
+        Handle& operator=(Handle&& other) noexcept {
+            if (this != &other) {
+                release();
+                std::swap(backend, other.backend);
+                std::swap(session, other.session);
+            }
+            return *this;
+        }
+
+        Session* operator->() const { return session; }
+        Session& operator*() const { return *session; }
+        explicit operator bool() const { return session != nullptr; }
+
+    private:
+        void release() {
+            if (backend != nullptr && session != nullptr) {
+                backend->release(session);
+            }
+            backend = nullptr;
+            session = nullptr;
+        }
+
+        Backend* backend = nullptr;
+        Session* session = nullptr;
+    };
+
+    // Opens a new session, or returns nullptr if the storage refuses it.
+    using Opener = std::function<std::unique_ptr<Session>()>;
+
+    // The first session is opened upfront, so an unreachable storage is
+    // reported once, instead of on every query.
+    Backend(const std::string& name, size_t max_size, Opener opener);
+
+    Backend(const Backend&) = delete;
+    Backend& operator=(const Backend&) = delete;
+
+    // False if we could not connect to the storage at all.
+    bool is_valid() const { return valid; }
+    // Maximum number of sessions the backend opens.
+    size_t capacity() {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        return max_size;
+    }
+    // Blocks until a session is available, returns an empty handle if the
+    // storage is not reachable.
+    Handle acquire();
+
+    // Number of sessions opened, and of connections lost and reestablished by
+    // the sessions.
+    uint64_t sessions_opened() const {
+        return opened.load(std::memory_order_relaxed);
+    }
+    uint64_t reconnects() const {
+        return reconnected.load(std::memory_order_relaxed);
+    }
+
+private:
+    void release(Session* session);
+    // Opens a new session, counting it.
+    std::unique_ptr<Session> open();
+
+    const std::string name;
+    const Opener opener;
+
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    std::vector<Session*> idle;
+    std::vector<std::unique_ptr<Session>> all;
+    size_t max_size;
+    bool valid = false;
+    std::atomic<uint64_t> opened{0};
+    std::atomic<uint64_t> reconnected{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,64 @@
+#include "compression.h"
+
+#include <cstring>
+
+#ifdef USD_SQL_ZSTD
+#include <zstd.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+// Little endian 0xFD2FB528.
+constexpr unsigned char MAGIC[4] = {0x28, 0xb5, 0x2f, 0xfd};
+
+} // namespace
+
+bool compression_supported() {
+#ifdef USD_SQL_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool is_compressed(const char* data, size_t size) {
+    return size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+size_t decompressed_size(const char* header, size_t header_size) {
+#ifdef USD_SQL_ZSTD
+    const auto size = ZSTD_getFrameContentSize(header, header_size);
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+        return 0;
+    }
+    return static_cast<size_t>(size);
+#else
+    return 0;
+#endif
+}
+
+bool decompress(const char* data, size_t size, char* out, size_t out_size) {
+#ifdef USD_SQL_ZSTD
+    const auto ret = ZSTD_decompress(out, out_size, data, size);
+    return !ZSTD_isError(ret) && ret == out_size;
+#else
+    return false;
+#endif
+}
+
+std::string compress(const std::string& data, int level) {
+#ifdef USD_SQL_ZSTD
+    std::string ret(ZSTD_compressBound(data.size()), '\0');
+    const auto size =
+        ZSTD_compress(&ret[0], ret.size(), data.data(), data.size(), level);
+    if (ZSTD_isError(size)) { return data; }
+    ret.resize(size);
+    return ret;
+#else
+    return data;
+#endif
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
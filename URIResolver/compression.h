@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <cstddef>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Assets can be stored compressed as zstd frames. Compressed data is detected
+// by the magic number at the start of the frame, so compressed and
+// uncompressed assets can be mixed in the same table. Support is only built
+// when USD_SQL_ZSTD is defined.
+
+// Number of bytes needed to read the size of the decompressed data.
+constexpr size_t COMPRESSION_HEADER_SIZE = 18;
+
+// True if support for compressed data was built.
+bool compression_supported();
+// True if the data starts with the magic number of a compressed frame.
+bool is_compressed(const char* data, size_t size);
+// Size of the decompressed data, read from the header of the frame, or 0 if
+// the size is unknown or not supported.
+size_t decompressed_size(const char* header, size_t header_size);
+// Decompresses the whole frame into out, which has to be exactly as large as
+// the decompressed data.
+bool decompress(const char* data, size_t size, char* out, size_t out_size);
+// Compresses the data at the given level, for writing to the table. Returns
+// the data unchanged if compression is not supported.
+std::string compress(const std::string& data, int level);
+
+PXR_NAMESPACE_CLOSE_SCOPE
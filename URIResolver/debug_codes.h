@@ -8,3 +8,29 @@ PXR_NAMESPACE_OPEN_SCOPE
 TF_DEBUG_CODES(USD_URI_RESOLVER, USD_URI_SQL_RESOLVER);
 
 PXR_NAMESPACE_CLOSE_SCOPE
+
+// -----------------------------------------------------------------------------
+// If you want to print out a stacktrace everywhere SQL_WARN is called, set this
+// to a value > 0 - it will print out this number of stacktrace entries
+#define USD_SQL_DEBUG_STACKTRACE_SIZE 0
+
+#if USD_SQL_DEBUG_STACKTRACE_SIZE > 0
+
+#include <execinfo.h>
+
+#define SQL_WARN                                                          \
+    {                                                                     \
+        void* backtrace_array[USD_SQL_DEBUG_STACKTRACE_SIZE];             \
+        size_t stack_size =                                               \
+            backtrace(backtrace_array, USD_SQL_DEBUG_STACKTRACE_SIZE);    \
+        TF_WARN("\n\n====================================\n");            \
+        TF_WARN("Stacktrace:\n");                                         \
+        backtrace_symbols_fd(backtrace_array, stack_size, STDERR_FILENO); \
+    }                                                                     \
+    TF_WARN
+
+#else // STACKTRACE_SIZE
+
+#define SQL_WARN TF_WARN
+
+#endif // STACKTRACE_SIZE
@@ -0,0 +1,282 @@
+#include "disk_cache.h"
+
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "debug_codes.h"
+#include "memory_asset.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+constexpr char MAGIC[8] = {'U', 'S', 'D', 'S', 'Q', 'L', 'C', '3'};
+
+// The file starts with the header, followed by the key, then the data at a
+// page aligned offset, so it can be mapped directly. The header and key are
+// checked in full, the data only in samples, so a hit doesn't read the whole
+// file.
+struct Header {
+    char magic[8];
+    uint64_t key_size;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t checksum;
+    uint64_t data_checksum;
+    double timestamp;
+};
+
+// Data up to this size is checked in full. Larger data is checked in
+// DATA_SAMPLES evenly spread samples of DATA_SAMPLE_SIZE bytes, including the
+// first and the last bytes.
+constexpr size_t FULL_CHECKSUM_MAX_SIZE = 256 * 1024;
+constexpr size_t DATA_SAMPLES = 64;
+constexpr size_t DATA_SAMPLE_SIZE = 4096;
+
+// Not cryptographic, only catches truncated or damaged files.
+uint64_t checksum(const char* data, size_t size) {
+    constexpr uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+uint64_t data_checksum(const char* data, size_t size) {
+    if (size <= FULL_CHECKSUM_MAX_SIZE) { return checksum(data, size); }
+    const auto stride = (size - DATA_SAMPLE_SIZE) / (DATA_SAMPLES - 1);
+    uint64_t hash = size;
+    for (size_t i = 0; i < DATA_SAMPLES; ++i) {
+        hash = hash * 31 + checksum(data + i * stride, DATA_SAMPLE_SIZE);
+    }
+    return hash;
+}
+
+uint64_t header_checksum(Header header, const std::string& key) {
+    header.checksum = 0;
+    std::vector<char> buffer(sizeof(header) + key.size());
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), key.data(), key.size());
+    return checksum(buffer.data(), buffer.size());
+}
+
+#ifndef _WIN32
+
+uint64_t page_size() {
+    static const auto size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+bool read_all(int fd, void* buffer, size_t size, off_t offset) {
+    auto* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        const auto ret = pread(fd, out, size, offset);
+        if (ret <= 0) { return false; }
+        out += ret;
+        size -= static_cast<size_t>(ret);
+        offset += ret;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* buffer, size_t size, off_t offset) {
+    const auto* in = static_cast<const char*>(buffer);
+    while (size > 0) {
+        const auto ret = pwrite(fd, in, size, offset);
+        if (ret <= 0) { return false; }
+        in += ret;
+        size -= static_cast<size_t>(ret);
+        offset += ret;
+    }
+    return true;
+}
+
+// Checks that the file holds the given version of the asset.
+bool read_header(
+    int fd, const std::string& key, double timestamp, Header& header) {
+    if (!read_all(fd, &header, sizeof(header), 0) ||
+        memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.timestamp != timestamp || header.key_size != key.size() ||
+        header.data_offset % page_size() != 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) <
+                                   header.data_offset + header.data_size) {
+        return false;
+    }
+    std::vector<char> stored_key(key.size());
+    return read_all(fd, stored_key.data(), key.size(), sizeof(header)) &&
+           memcmp(stored_key.data(), key.data(), key.size()) == 0 &&
+           header_checksum(header, key) == header.checksum;
+}
+
+#endif
+
+} // namespace
+
+DiskCache::DiskCache(const std::string& root, const std::string& server_name)
+    : root(root), server_name(server_name) {
+    if (!TfMakeDirs(root, -1, true)) {
+        TF_WARN(
+            "[SQLResolver] Could not create the cache directory %s",
+            root.c_str());
+    }
+}
+
+std::string DiskCache::make_key(const TfToken& asset_path) const {
+    return server_name + '\n' + asset_path.GetString();
+}
+
+std::string DiskCache::file_name(const std::string& key) const {
+    // The key itself is stored in the file, so collisions are detected.
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    return TfStringPrintf(
+        "%s/%016llx.usdsql", root.c_str(),
+        static_cast<unsigned long long>(hash));
+}
+
+#ifndef _WIN32
+
+std::shared_ptr<ArAsset> DiskCache::load(
+    const TfToken& asset_path, double timestamp) const {
+    const auto key = make_key(asset_path);
+    const auto path = file_name(key);
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return nullptr; }
+
+    Header header;
+    if (!read_header(fd, key, timestamp, header)) {
+        close(fd);
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "DiskCache::load: no matching entry for %s\n",
+                asset_path.GetText());
+        return nullptr;
+    }
+
+    const auto size = static_cast<size_t>(header.data_size);
+    std::shared_ptr<char> data;
+    if (size > 0) {
+        auto* mapped = mmap(
+            nullptr, size, PROT_READ, MAP_PRIVATE, fd,
+            static_cast<off_t>(header.data_offset));
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        data.reset(
+            static_cast<char*>(mapped),
+            [size](char* p) { munmap(p, size); });
+    }
+
+    if (data_checksum(data.get(), size) != header.data_checksum) {
+        close(fd);
+        TF_WARN(
+            "[SQLResolver] Removing damaged cache file %s for %s",
+            path.c_str(), asset_path.GetText());
+        unlink(path.c_str());
+        return nullptr;
+    }
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("DiskCache::load: using %s for %s\n", path.c_str(),
+             asset_path.GetText());
+    // File consumers of large assets read the cache file directly, as long
+    // as a descriptor can be kept open for them.
+    if (size < FILE_BACKED_MIN_SIZE || !reserve_asset_fd()) {
+        close(fd);
+        return std::make_shared<MemoryAsset>(std::move(data), size);
+    }
+    return std::make_shared<MemoryAsset>(
+        std::move(data), size, fd, static_cast<size_t>(header.data_offset));
+}
+
+void DiskCache::store(
+    const TfToken& asset_path, double timestamp, const char* data,
+    size_t size) const {
+    const auto key = make_key(asset_path);
+    const auto path = file_name(key);
+    // Written next to the final file, so the rename stays on one file system.
+    auto temp_path = path + ".XXXXXX";
+    const auto fd = mkstemp(&temp_path[0]);
+    if (fd < 0) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg("DiskCache::store: could not create %s\n", temp_path.c_str());
+        return;
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.key_size = key.size();
+    const auto page = page_size();
+    header.data_offset = (sizeof(header) + key.size() + page - 1) / page * page;
+    header.data_size = size;
+    header.data_checksum = data_checksum(data, size);
+    header.timestamp = timestamp;
+    header.checksum = header_checksum(header, key);
+
+    // Other users on the node can read the cache, but not change it.
+    const auto written =
+        fchmod(fd, 0644) == 0 && write_all(fd, &header, sizeof(header), 0) &&
+        write_all(fd, key.data(), key.size(), sizeof(header)) &&
+        ftruncate(fd, static_cast<off_t>(header.data_offset + size)) == 0 &&
+        write_all(fd, data, size, static_cast<off_t>(header.data_offset)) &&
+        fsync(fd) == 0;
+    close(fd);
+    if (!written || rename(temp_path.c_str(), path.c_str()) != 0) {
+        TF_WARN(
+            "[SQLResolver] Could not write cache file %s for %s",
+            path.c_str(), asset_path.GetText());
+        unlink(temp_path.c_str());
+        return;
+    }
+    // The rename itself only survives a crash once the directory is synced.
+    const auto dir = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("DiskCache::store: stored %s in %s\n", asset_path.GetText(),
+             path.c_str());
+}
+
+#else
+
+std::shared_ptr<ArAsset> DiskCache::load(
+    const TfToken& asset_path, double timestamp) const {
+    return nullptr;
+}
+
+void DiskCache::store(
+    const TfToken& asset_path, double timestamp, const char* data,
+    size_t size) const {}
+
+#endif
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <pxr/base/tf/token.h>
+
+#include <pxr/usd/ar/asset.h>
+
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Keeps downloaded assets in a local directory, so other processes and later
+// runs don't have to download them again. There is one file per asset,
+// holding the latest version stored. Files are only renamed into place once
+// fully written, and their contents are checked before use, so several
+// processes can share the directory, and files left behind by a crash are
+// never used.
+class DiskCache {
+public:
+    DiskCache(const std::string& root, const std::string& server_name);
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    // Returns the stored data of the asset, if it was stored with the same
+    // timestamp. The data is mapped to memory, not read.
+    std::shared_ptr<ArAsset> load(
+        const TfToken& asset_path, double timestamp) const;
+    // Stores the data of the asset, replacing any previous version.
+    void store(
+        const TfToken& asset_path, double timestamp, const char* data,
+        size_t size) const;
+
+private:
+    std::string file_name(const std::string& key) const;
+    std::string make_key(const TfToken& asset_path) const;
+
+    const std::string root;
+    const std::string server_name;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Histogram of latencies, or any other non-negative values. Each power of two
+// is split in SUB_BUCKET_COUNT linear buckets, so percentiles are within a few
+// percent of the recorded values, with a fixed memory footprint. Recording is
+// lock free and safe from multiple threads.
+class Histogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 5;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT =
+        (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    Histogram() { reset(); }
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(uint64_t value) {
+        buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        auto current_max = maximum.load(std::memory_order_relaxed);
+        while (value > current_max &&
+               !maximum.compare_exchange_weak(
+                   current_max, value, std::memory_order_relaxed)) {}
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            const auto bucket =
+                other.buckets[i].load(std::memory_order_relaxed);
+            if (bucket != 0) {
+                buckets[i].fetch_add(bucket, std::memory_order_relaxed);
+            }
+        }
+        total.fetch_add(other.count(), std::memory_order_relaxed);
+        sum.fetch_add(
+            other.sum.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+        const auto other_max = other.max();
+        auto current_max = maximum.load(std::memory_order_relaxed);
+        while (other_max > current_max &&
+               !maximum.compare_exchange_weak(
+                   current_max, other_max, std::memory_order_relaxed)) {}
+    }
+
+    // Not atomic as a whole, values recorded meanwhile might be lost.
+    void reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        const auto recorded = count();
+        return recorded == 0 ? 0.0
+                             : static_cast<double>(
+                                   sum.load(std::memory_order_relaxed)) /
+                                   static_cast<double>(recorded);
+    }
+
+    // Upper bound of the bucket holding the given fraction of the values,
+    // for example 0.99 for the 99th percentile.
+    uint64_t percentile(double fraction) const {
+        const auto recorded = count();
+        if (recorded == 0) { return 0; }
+        auto rank = static_cast<uint64_t>(fraction * recorded);
+        if (rank >= recorded) { rank = recorded - 1; }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                const auto upper = bucket_upper_bound(i);
+                return upper < max() ? upper : max();
+            }
+        }
+        return max();
+    }
+
+private:
+    static size_t bucket_index(uint64_t value) {
+        if (value < SUB_BUCKET_COUNT) { return static_cast<size_t>(value); }
+        size_t exponent = 63;
+        while ((value >> exponent) == 0) { --exponent; }
+        const auto shift = exponent - SUB_BUCKET_BITS;
+        const auto sub_bucket =
+            static_cast<size_t>(value >> shift) - SUB_BUCKET_COUNT;
+        return (shift + 1) * SUB_BUCKET_COUNT + sub_bucket;
+    }
+
+    static uint64_t bucket_upper_bound(size_t index) {
+        if (index < SUB_BUCKET_COUNT) { return index; }
+        const auto shift = index / SUB_BUCKET_COUNT - 1;
+        const auto sub_bucket = index % SUB_BUCKET_COUNT;
+        return ((uint64_t{SUB_BUCKET_COUNT + sub_bucket + 1} << shift) - 1);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maximum;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
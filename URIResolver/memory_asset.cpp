@@ -2,15 +2,102 @@
 
 #include <pxr/base/tf/diagnostic.h>
 
+#include <atomic>
+#include <cstdlib>
 #include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 
 PXR_NAMESPACE_OPEN_SCOPE
 
-MemoryAsset::MemoryAsset(const char* raw, size_t size) : data_size(size) {
+namespace {
+
+std::atomic<size_t> asset_fds{0};
+
+size_t get_max_asset_fds() {
+#ifndef _WIN32
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+        return static_cast<size_t>(limit.rlim_cur / 4);
+    }
+#endif
+    return 1024;
+}
+
+} // namespace
+
+bool reserve_asset_fd() {
+    static const size_t max_asset_fds = get_max_asset_fds();
+    auto used = asset_fds.load(std::memory_order_relaxed);
+    do {
+        if (used >= max_asset_fds) { return false; }
+    } while (!asset_fds.compare_exchange_weak(
+        used, used + 1, std::memory_order_relaxed));
+    return true;
+}
+
+void release_asset_fd() { asset_fds.fetch_sub(1, std::memory_order_relaxed); }
+
+void close_asset_fd(int fd) {
+    if (fd < 0) { return; }
+#ifndef _WIN32
+    close(fd);
+#endif
+    release_asset_fd();
+}
+
+std::shared_ptr<char> allocate_asset_buffer(size_t size, int& fd) {
+    fd = -1;
+    if (size == 0) { return nullptr; }
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (size >= FILE_BACKED_MIN_SIZE && reserve_asset_fd()) {
+        fd = memfd_create("usd_sql_asset", MFD_CLOEXEC);
+        if (fd < 0) { release_asset_fd(); }
+    }
+    if (fd >= 0) {
+        void* mapped = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+            mapped = mmap(
+                nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapped != MAP_FAILED) {
+            return std::shared_ptr<char>(
+                static_cast<char*>(mapped),
+                [size](char* p) { munmap(p, size); });
+        }
+        close_asset_fd(fd);
+        fd = -1;
+    }
+#endif
+    auto* d = static_cast<char*>(malloc(size));
+    if (d == nullptr) { return nullptr; }
+    return std::shared_ptr<char>(d, [](char* p) { free(p); });
+}
+
+MemoryAsset::MemoryAsset(const char* raw, size_t size)
+    : data_size(size), fd(-1), fd_offset(0) {
     if (size > 0) {
-        auto* d = static_cast<char*>(malloc(data_size));
-        memcpy(d, raw, data_size);
-        data.reset(d, [](char* p) { free(p); });
+        data = allocate_asset_buffer(data_size, fd);
+        if (TF_VERIFY(data != nullptr)) { memcpy(data.get(), raw, data_size); }
+    }
+}
+
+MemoryAsset::MemoryAsset(
+    std::shared_ptr<char> data, size_t size, int fd, size_t fd_offset)
+    : data(std::move(data)), data_size(size), fd(fd), fd_offset(fd_offset) {}
+
+MemoryAsset::~MemoryAsset() {
+    if (temp != nullptr) { fclose(temp); }
+    if (temp_owns_fd) {
+        release_asset_fd();
+    } else {
+        close_asset_fd(fd);
     }
 }
 
@@ -26,16 +113,23 @@ size_t MemoryAsset::_Read(void* buffer, size_t count, size_t offset) const {
 }
 
 std::pair<FILE*, size_t> MemoryAsset::_GetFileUnsafe() const {
-    if (temp == nullptr) {
-        std::lock_guard<std::mutex> lock(temp_mutex);
-        if (temp == nullptr) {
-            temp = tmpfile();
-            if (!TF_VERIFY(temp != nullptr)) {
-                return {nullptr, 0};
-            }
-            fwrite(data.get(), data_size, 1, temp);
+    std::lock_guard<std::mutex> lock(temp_mutex);
+    if (temp != nullptr) { return {temp, temp_offset}; }
+#ifndef _WIN32
+    // Shares the pages of the buffer, nothing is copied. The file takes over
+    // the descriptor, so it is not duplicated.
+    if (fd >= 0) {
+        temp = fdopen(fd, "rb");
+        if (temp != nullptr) {
+            temp_owns_fd = true;
+            temp_offset = fd_offset;
+            return {temp, temp_offset};
         }
     }
+#endif
+    temp = tmpfile();
+    if (!TF_VERIFY(temp != nullptr)) { return {nullptr, 0}; }
+    fwrite(data.get(), data_size, 1, temp);
     return {temp, 0};
 }
 
@@ -4,14 +4,44 @@
 
 #include <pxr/usd/ar/asset.h>
 
+#include <memory>
 #include <mutex>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+// Smaller assets are copied to a temporary file when a file is requested,
+// instead of keeping a file descriptor open for each of them.
+constexpr size_t FILE_BACKED_MIN_SIZE = 1024 * 1024;
+
+// Assets keep at most a quarter of the process' file descriptor limit open,
+// so a stage with thousands of large layers doesn't starve the rest of the
+// process. Reserves one of those descriptors, returns false if all of them are
+// in use.
+bool reserve_asset_fd();
+// Gives back a reservation, after its descriptor was closed by other means,
+// like fclose on a file opened with fdopen.
+void release_asset_fd();
+// Closes a descriptor kept open by an asset, and gives back its reservation.
+void close_asset_fd(int fd);
+
+// Allocates a writable buffer for an asset. Where supported, buffers of at
+// least FILE_BACKED_MIN_SIZE bytes are mapped from an anonymous file, returned
+// in fd, so the asset can hand out the same pages as a file. Otherwise, or if
+// no descriptor could be reserved, fd is set to -1. A returned fd has to be
+// closed with close_asset_fd.
+std::shared_ptr<char> allocate_asset_buffer(size_t size, int& fd);
+
 class MemoryAsset final : public ArAsset {
 public:
     MemoryAsset(const char* raw, size_t size);
-    ~MemoryAsset() override = default;
+    // Takes ownership of an already filled buffer, without copying it. If fd
+    // is not -1, it has to be reserved with reserve_asset_fd, the asset takes
+    // ownership of it too, and the data is read from the file at fd_offset
+    // when a file is requested.
+    MemoryAsset(
+        std::shared_ptr<char> data, size_t size, int fd = -1,
+        size_t fd_offset = 0);
+    ~MemoryAsset() override;
 
     MemoryAsset(const MemoryAsset&) = delete;
     MemoryAsset(MemoryAsset&&) = delete;
@@ -53,9 +83,15 @@ private:
     // need to outlive the asset.
     std::shared_ptr<char> data;
     size_t data_size;
+    // File holding the same data, or -1.
+    int fd;
+    size_t fd_offset;
     mutable std::mutex temp_mutex;
-    // This is going to be from tmpfile(), so no need to manually free it.
+    // Opened on the first request, closed with the asset.
     mutable FILE* temp = nullptr;
+    // Set if temp was opened on fd, and closes it.
+    mutable bool temp_owns_fd = false;
+    mutable size_t temp_offset = 0;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,1037 @@
+#include "mysql_backend.h"
+
+#include <pxr/base/tf/diagnosticLite.h>
+#include <pxr/base/trace/trace.h>
+
+#include <errmsg.h>
+#include <my_global.h>
+#include <my_sys.h>
+#include <mysql.h>
+#include <mysqld_error.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include <z85/z85.hpp>
+
+#include "compression.h"
+#include "debug_codes.h"
+#include "memory_asset.h"
+#include "mysql_time.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+double convert_mysql_time(const MYSQL_TIME& time) {
+    TRACE_SCOPE("MySQL timestamp parsing");
+    std::tm parsed_time = {};
+    parsed_time.tm_year = static_cast<int>(time.year) - 1900;
+    parsed_time.tm_mon = static_cast<int>(time.month) - 1;
+    parsed_time.tm_mday = static_cast<int>(time.day);
+    parsed_time.tm_hour = static_cast<int>(time.hour);
+    parsed_time.tm_min = static_cast<int>(time.minute);
+    parsed_time.tm_sec = static_cast<int>(time.second);
+    parsed_time.tm_isdst = 0;
+    // I have to set daylight savings to 0
+    // for the asctime function to match the actual time
+    // even without that, the parsed times will be consistent, so
+    // probably it won't cause any issues
+    return static_cast<double>(mktime(&parsed_time)) +
+           static_cast<double>(time.second_part) / 1000000.0;
+}
+
+bool convert_to_mysql_time(double timestamp, MYSQL_TIME& time) {
+    const auto whole = std::floor(timestamp);
+    const auto seconds = static_cast<std::time_t>(whole);
+    // convert_mysql_time ignores daylight saving, so local times are always
+    // the standard offset away from UTC.
+    std::tm broken_time = {};
+    if (gmtime_r(&seconds, &broken_time) == nullptr) { return false; }
+    broken_time.tm_isdst = 0;
+    const auto local = seconds + (seconds - mktime(&broken_time));
+    if (gmtime_r(&local, &broken_time) == nullptr) { return false; }
+    time = {};
+    time.year = static_cast<unsigned int>(broken_time.tm_year + 1900);
+    time.month = static_cast<unsigned int>(broken_time.tm_mon + 1);
+    time.day = static_cast<unsigned int>(broken_time.tm_mday);
+    time.hour = static_cast<unsigned int>(broken_time.tm_hour);
+    time.minute = static_cast<unsigned int>(broken_time.tm_min);
+    time.second = static_cast<unsigned int>(broken_time.tm_sec);
+    time.second_part =
+        static_cast<unsigned long>(std::lround((timestamp - whole) * 1e6));
+    time.time_type = MYSQL_TIMESTAMP_DATETIME;
+    return convert_mysql_time(time) == timestamp;
+}
+
+namespace {
+
+constexpr auto PORT_ENV_VAR = "USD_SQL_PORT";
+constexpr auto DB_ENV_VAR = "USD_SQL_DB";
+constexpr auto USER_ENV_VAR = "USD_SQL_USER";
+constexpr auto PASSWORD_ENV_VAR = "USD_SQL_PASSWD";
+constexpr auto POOL_SIZE_ENV_VAR = "USD_SQL_POOL_SIZE";
+
+// -----------------------------------------------------------------------------
+
+// If you want to control the number of seconds an idle connection is kept alive
+// for, set this to something other than zero
+
+#define SESSION_WAIT_TIMEOUT 0
+
+#if SESSION_WAIT_TIMEOUT > 0
+
+#define _USD_SQL_SIMPLE_QUOTE(ARG) #ARG
+#define _USD_SQL_EXPAND_AND_QUOTE(ARG) _SIMPLE_QUOTE(ARG)
+#define SET_SESSION_WAIT_TIMEOUT_QUERY                      \
+    ("SET SESSION wait_timeout=" _USD_SQL_EXPAND_AND_QUOTE( \
+        SESSION_WAIT_TIMEOUT))
+#define SET_SESSION_WAIT_TIMEOUT_QUERY_STRLEN \
+    (sizeof(SET_SESSION_WAIT_TIMEOUT_QUERY) - 1)
+
+#endif // SESSION_WAIT_TIMEOUT
+
+thread_local std::once_flag thread_flag;
+
+void sql_thread_init() {
+    std::call_once(thread_flag, []() { my_thread_init(); });
+}
+
+enum StatementKind {
+    STATEMENT_RESOLVE,
+    STATEMENT_TIMESTAMP,
+    STATEMENT_DATA,
+    STATEMENT_DATA_IF_NEWER,
+    STATEMENT_RESOLVE_BATCH,
+    STATEMENT_DATA_BATCH,
+    STATEMENT_LATEST_CHANGE,
+    STATEMENT_CHANGES,
+    STATEMENT_RANGE,
+    STATEMENT_HASH,
+    STATEMENT_HASH_BATCH,
+    STATEMENT_COUNT
+};
+
+// Number of paths queried at once by the batched statements. Smaller batches
+// are padded by repeating the last path.
+constexpr size_t QUERY_BATCH_SIZE = 64;
+
+// The client library reads a whole row before handing out its columns, so
+// larger blobs are left out of the data statements, and downloaded in chunks
+// of this size with the range statement instead.
+constexpr size_t FETCH_CHUNK_SIZE = 8 * 1024 * 1024;
+
+using StatementQueries = std::array<std::string, STATEMENT_COUNT>;
+
+// The hash queries are left empty, and never used, without a hash column.
+StatementQueries make_statement_queries(
+    const std::string& table_name, const std::string& hash_column) {
+    std::string batch = "?";
+    for (size_t i = 1; i < QUERY_BATCH_SIZE; ++i) { batch += ", ?"; }
+    // The data is NULL if it has to be downloaded in chunks.
+    const auto data = "IF(OCTET_LENGTH(data) <= " +
+                      std::to_string(FETCH_CHUNK_SIZE) +
+                      ", data, NULL), OCTET_LENGTH(data)";
+    StatementQueries queries;
+    queries[STATEMENT_RESOLVE] = "SELECT timestamp, OCTET_LENGTH(data) FROM " +
+                                 table_name + " WHERE path = ? LIMIT 1";
+    queries[STATEMENT_TIMESTAMP] =
+        "SELECT timestamp FROM " + table_name + " WHERE path = ? LIMIT 1";
+    queries[STATEMENT_DATA] = "SELECT " + data + ", timestamp FROM " +
+                              table_name + " WHERE path = ? LIMIT 1";
+    queries[STATEMENT_DATA_IF_NEWER] =
+        "SELECT " + data + ", timestamp FROM " + table_name +
+        " WHERE path = ? AND timestamp > ? LIMIT 1";
+    queries[STATEMENT_RESOLVE_BATCH] =
+        "SELECT path, timestamp, OCTET_LENGTH(data) FROM " + table_name +
+        " WHERE path IN (" + batch + ")";
+    queries[STATEMENT_DATA_BATCH] = "SELECT path, " + data +
+                                    ", timestamp FROM " + table_name +
+                                    " WHERE path IN (" + batch + ")";
+    queries[STATEMENT_LATEST_CHANGE] = "SELECT MAX(timestamp) FROM " + table_name;
+    // Rows changed in the same second as the last change are returned again,
+    // so we don't miss anything written after the previous poll.
+    queries[STATEMENT_CHANGES] = "SELECT path, timestamp FROM " + table_name +
+                                 " WHERE timestamp >= ?";
+    // SUBSTRING counts from 1.
+    queries[STATEMENT_RANGE] =
+        "SELECT SUBSTRING(data, ? + 1, ?), timestamp FROM " + table_name +
+        " WHERE path = ? LIMIT 1";
+    if (!hash_column.empty()) {
+        queries[STATEMENT_HASH] = "SELECT " + hash_column +
+                                  ", timestamp FROM " + table_name +
+                                  " WHERE path = ? LIMIT 1";
+        queries[STATEMENT_HASH_BATCH] = "SELECT path, " + hash_column +
+                                        ", timestamp FROM " + table_name +
+                                        " WHERE path IN (" + batch + ")";
+    }
+    return queries;
+}
+
+bool is_connection_lost(unsigned int error) {
+    return error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST;
+}
+
+// The statements are lost when the server drops the connection, even if the
+// client reconnects automatically.
+bool needs_reprepare(unsigned int error) {
+    return is_connection_lost(error) || error == ER_UNKNOWN_STMT_HANDLER ||
+           error == ER_NEED_REPREPARE;
+}
+
+// The string has to outlive the execution of the statement.
+MYSQL_BIND bind_string(const std::string& str) {
+    MYSQL_BIND bind = {};
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char*>(str.c_str());
+    bind.buffer_length = str.size();
+    return bind;
+}
+
+MYSQL_BIND bind_time(MYSQL_TIME& time, my_bool& is_null) {
+    MYSQL_BIND bind = {};
+    bind.buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind.buffer = &time;
+    bind.is_null = &is_null;
+    return bind;
+}
+
+MYSQL_BIND bind_size(unsigned long long& size, my_bool& is_null) {
+    MYSQL_BIND bind = {};
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &size;
+    bind.is_unsigned = 1;
+    bind.is_null = &is_null;
+    return bind;
+}
+
+// Frees the result of an executed statement and discards the rows we did not
+// read, so the statement can be executed again.
+struct StatementResult {
+    explicit StatementResult(MYSQL_STMT* statement) : statement(statement) {}
+    ~StatementResult() { mysql_stmt_free_result(statement); }
+
+    StatementResult(const StatementResult&) = delete;
+    StatementResult& operator=(const StatementResult&) = delete;
+
+    MYSQL_STMT* statement;
+};
+
+// Returns false if there are no more rows, or fetching failed.
+bool fetch_row(MYSQL_STMT* statement) {
+    TRACE_SCOPE("MySQL result transfer");
+    const auto ret = mysql_stmt_fetch(statement);
+    // Truncation is expected for blobs, we read those with
+    // mysql_stmt_fetch_column.
+    if (ret == 0 || ret == MYSQL_DATA_TRUNCATED) { return true; }
+    if (ret != MYSQL_NO_DATA) {
+        SQL_WARN(
+            "[SQLResolver] Error fetching row\nError code: %i\nError string: "
+            "%s",
+            mysql_stmt_errno(statement), mysql_stmt_error(statement));
+    }
+    return false;
+}
+
+// Reads a column bound without a buffer, after fetching the row, into a buffer
+// of the length reported by the fetch.
+bool fetch_column(
+    MYSQL_STMT* statement, unsigned int column, char* buffer,
+    unsigned long length) {
+    if (length == 0) { return true; }
+    TRACE_SCOPE("MySQL result transfer");
+    TRACE_COUNTER_DELTA("SQL bytes transferred", length);
+    MYSQL_BIND bind = {};
+    bind.buffer_type = MYSQL_TYPE_BLOB;
+    bind.buffer = buffer;
+    bind.buffer_length = length;
+    bind.length = &length;
+    if (mysql_stmt_fetch_column(statement, &bind, column, 0) != 0) {
+        SQL_WARN(
+            "[SQLResolver] Error fetching column %u\nError code: %i\nError "
+            "string: %s",
+            column, mysql_stmt_errno(statement), mysql_stmt_error(statement));
+        return false;
+    }
+    return true;
+}
+
+// Allocates the buffer of an asset, warning if that fails.
+std::shared_ptr<char> allocate_buffer(size_t size, int& fd) {
+    TRACE_SCOPE("MemoryAsset construction");
+    auto data = allocate_asset_buffer(size, fd);
+    if (size > 0 && data == nullptr) {
+        SQL_WARN(
+            "[SQLResolver] Failed allocating %zu bytes for an asset", size);
+    }
+    return data;
+}
+
+// Returns the decompressed size stored in the header, warning if there is
+// none.
+size_t checked_decompressed_size(const char* header, size_t header_size) {
+    const auto size = decompressed_size(header, header_size);
+    if (size == 0) {
+        SQL_WARN(
+            "[SQLResolver] Can't decompress asset, %s",
+            compression_supported() ? "the size is not stored"
+                                    : "zstd support was not built");
+    }
+    return size;
+}
+
+// Decompresses downloaded data into the buffer of a new MemoryAsset.
+std::shared_ptr<ArAsset> decompress_asset(
+    const std::vector<char>& compressed, size_t size) {
+    int fd = -1;
+    auto data = allocate_buffer(size, fd);
+    if (data == nullptr) { return nullptr; }
+    {
+        TRACE_SCOPE("Asset decompression");
+        if (!decompress(
+                compressed.data(), compressed.size(), data.get(), size)) {
+            SQL_WARN("[SQLResolver] Failed decompressing asset");
+            close_asset_fd(fd);
+            return nullptr;
+        }
+    }
+    return std::make_shared<MemoryAsset>(std::move(data), size, fd);
+}
+
+// Reads a compressed blob column, and decompresses it into the buffer of a new
+// MemoryAsset.
+std::shared_ptr<ArAsset> fetch_compressed_column(
+    MYSQL_STMT* statement, unsigned int column, unsigned long length,
+    const char* header, size_t header_size) {
+    const auto size = checked_decompressed_size(header, header_size);
+    if (size == 0) { return nullptr; }
+    std::vector<char> compressed(length);
+    if (!fetch_column(statement, column, compressed.data(), length)) {
+        return nullptr;
+    }
+    return decompress_asset(compressed, size);
+}
+
+// Reads a blob column straight into the buffer of a new MemoryAsset, so the
+// data is not copied again after leaving the client library. The client
+// library still holds the whole row while it is fetched, which is why the
+// data statements leave out blobs larger than FETCH_CHUNK_SIZE.
+std::shared_ptr<ArAsset> fetch_blob_column(
+    MYSQL_STMT* statement, unsigned int column, unsigned long length) {
+    char header[COMPRESSION_HEADER_SIZE];
+    const auto header_size =
+        std::min<unsigned long>(COMPRESSION_HEADER_SIZE, length);
+    if (!fetch_column(statement, column, header, header_size)) {
+        return nullptr;
+    }
+    if (is_compressed(header, header_size)) {
+        return fetch_compressed_column(
+            statement, column, length, header, header_size);
+    }
+
+    int fd = -1;
+    auto data = allocate_buffer(length, fd);
+    if (length > 0 && data == nullptr) { return nullptr; }
+    if (!fetch_column(statement, column, data.get(), length)) {
+        close_asset_fd(fd);
+        return nullptr;
+    }
+    return std::make_shared<MemoryAsset>(std::move(data), length, fd);
+}
+
+// Reads the data and the timestamp returned by one of the data statements.
+// result is set to RESOLVE_MISSING if no row was returned. Data that has to
+// be downloaded in chunks is left to the caller, setting chunked_size.
+std::shared_ptr<ArAsset> read_asset_row(
+    MYSQL_STMT* statement, double& timestamp, ResolveResult& result,
+    size_t& chunked_size) {
+    StatementResult statement_result(statement);
+    result = RESOLVE_FAILED;
+
+    // We only ask for the length of the data first, then fetch it into a
+    // buffer of the right size. The statement is not buffered with
+    // mysql_stmt_store_result, so the client holds only the current row.
+    unsigned long data_length = 0;
+    my_bool data_is_null = 0;
+    unsigned long long size = 0;
+    my_bool size_is_null = 0;
+    MYSQL_TIME time;
+    my_bool time_is_null = 0;
+    MYSQL_BIND columns[3] = {
+        {}, bind_size(size, size_is_null), bind_time(time, time_is_null)};
+    columns[0].buffer_type = MYSQL_TYPE_BLOB;
+    columns[0].length = &data_length;
+    columns[0].is_null = &data_is_null;
+    if (mysql_stmt_bind_result(statement, columns) != 0) { return nullptr; }
+    if (!fetch_row(statement)) {
+        if (mysql_stmt_errno(statement) == 0) { result = RESOLVE_MISSING; }
+        return nullptr;
+    }
+    if (size_is_null) { return nullptr; }
+
+    timestamp = time_is_null ? INVALID_TIME : convert_mysql_time(time);
+    if (data_is_null) {
+        chunked_size = static_cast<size_t>(size);
+        result = RESOLVE_FOUND;
+        return nullptr;
+    }
+    auto asset = fetch_blob_column(statement, 0, data_length);
+    if (asset == nullptr) { return nullptr; }
+
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "SQLConnection::open_asset: successfully fetched "
+            "data\n");
+
+    if (timestamp == INVALID_TIME) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLConnection::open_asset: failed parsing "
+                "timestamp\n");
+    }
+    result = RESOLVE_FOUND;
+    return asset;
+}
+
+struct ServerConfig {
+    std::string name;
+    std::string user;
+    std::string password;
+    std::string db;
+    unsigned int port;
+};
+
+MYSQL* open_connection(const ServerConfig& server) {
+    sql_thread_init();
+    auto* connection = mysql_init(nullptr);
+    // Turn on auto-reconnect
+    // Note that it IS still possible for the reconnect to fail, and we
+    // don't do any explicit check for this; experimented with also adding
+    // a check with mysql_ping in get_connection after retrieving
+    // a cached result, but decided against this approach, as it added
+    // a lot of extra spam if something DID go wrong (because a lot of
+    // resolve name calls will still "work" by just using the cached
+    // result
+    // Also, it's good practice to add error checking after every usage
+    // of mysql anyway (can fail in more ways than just connection being
+    // lost), so these will catch / print error when reconnection fails
+    // as well
+    my_bool reconnect = 1;
+    mysql_options(connection, MYSQL_OPT_RECONNECT, &reconnect);
+    const auto ret = mysql_real_connect(
+        connection, server.name.c_str(), server.user.c_str(),
+        server.password.c_str(), server.db.c_str(), server.port, nullptr, 0);
+    if (ret == nullptr) {
+        SQL_WARN(
+            "[SQLResolver] Failed to connect to: %s\nReason: %s",
+            server.name.c_str(), mysql_error(connection));
+        mysql_close(connection);
+        return nullptr;
+    }
+#if SESSION_WAIT_TIMEOUT > 0
+    const auto query_ret = mysql_real_query(
+        connection, SET_SESSION_WAIT_TIMEOUT_QUERY,
+        SET_SESSION_WAIT_TIMEOUT_QUERY_STRLEN);
+    if (query_ret != 0) {
+        SQL_WARN(
+            "[SQLResolver] Error executing query: %s\nError code: "
+            "%i\nError string: %s",
+            SET_SESSION_WAIT_TIMEOUT_QUERY, mysql_errno(connection),
+            mysql_error(connection));
+    }
+#endif // SESSION_WAIT_TIMEOUT
+    return connection;
+}
+
+// A connection with the statements prepared on it. Statements are prepared on
+// first use and reused for every later query on the same connection.
+class MySQLSession final : public Backend::Session {
+public:
+    MySQLSession(
+        MYSQL* connection, std::shared_ptr<const StatementQueries> queries)
+        : connection(connection), queries(std::move(queries)) {}
+    ~MySQLSession() override {
+        close_statements();
+        mysql_close(connection);
+    }
+
+    MySQLSession(const MySQLSession&) = delete;
+    MySQLSession& operator=(const MySQLSession&) = delete;
+
+    ResolveResult resolve(
+        const TfToken& asset_path, double& timestamp, size_t& size) override;
+    double get_timestamp(const TfToken& asset_path) override;
+    std::shared_ptr<ArAsset> fetch(
+        const TfToken& asset_path, double& timestamp) override;
+    ResolveResult fetch_if_newer(
+        const TfToken& asset_path, double since,
+        std::shared_ptr<ArAsset>& asset, double& timestamp) override;
+    bool fetch_range(
+        const TfToken& asset_path, double timestamp, size_t offset,
+        size_t size, char* buffer) override;
+    bool hash(
+        const TfToken& asset_path, std::string& hash,
+        double& timestamp) override;
+    void resolve_batch(
+        const std::vector<TfToken>& asset_paths,
+        const ResolveCallback& on_result) override;
+    void fetch_batch(
+        const std::vector<TfToken>& asset_paths,
+        const FetchCallback& on_fetched) override;
+    void hash_batch(
+        const std::vector<TfToken>& asset_paths,
+        const HashCallback& on_hash) override;
+    bool latest_change(double& high_water) override;
+    bool changes(double& high_water, const ChangeCallback& on_change) override;
+
+private:
+    void close_statements() {
+        for (auto*& statement : statements) {
+            if (statement != nullptr) { mysql_stmt_close(statement); }
+            statement = nullptr;
+        }
+    }
+
+    // Drops the prepared statements after error, reconnecting first if the
+    // connection was lost.
+    void reset_statements(unsigned int error) {
+        close_statements();
+        if (is_connection_lost(error) && mysql_ping(connection) == 0) {
+            count_reconnect();
+        }
+    }
+
+    // Returns the executed statement, ready to bind the results to, or
+    // nullptr if the execution failed. Results are not buffered, so the rows
+    // are only transferred by fetch_row.
+    MYSQL_STMT* execute(StatementKind kind, MYSQL_BIND* params);
+    // Executes a batched statement for up to QUERY_BATCH_SIZE paths.
+    MYSQL_STMT* execute_batch(
+        StatementKind kind, const TfToken* paths, size_t count);
+    // Downloads a blob left out of a data statement in chunks of
+    // FETCH_CHUNK_SIZE, straight into the buffer of the asset, so the
+    // client library never holds more than one chunk. Fails if the row
+    // changes in between.
+    std::shared_ptr<ArAsset> fetch_chunked(
+        const TfToken& asset_path, double timestamp, size_t size);
+    // Downloads size bytes in chunks into buffer.
+    bool fetch_chunks(
+        const TfToken& asset_path, double timestamp, size_t size,
+        char* buffer);
+
+    MYSQL* connection;
+    const std::shared_ptr<const StatementQueries> queries;
+    std::array<MYSQL_STMT*, STATEMENT_COUNT> statements{};
+};
+
+MYSQL_STMT* MySQLSession::execute(StatementKind kind, MYSQL_BIND* params) {
+    TRACE_SCOPE("MySQL query round trip");
+    sql_thread_init();
+    const auto& query = (*queries)[kind];
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("MySQLSession::execute: query:\n%s\n", query.c_str());
+    // If the server went away, we reconnect, prepare the statement again and
+    // retry once.
+    for (auto attempt = 0; attempt < 2; ++attempt) {
+        auto*& statement = statements[kind];
+        if (statement == nullptr) {
+            statement = mysql_stmt_init(connection);
+            if (statement == nullptr) {
+                SQL_WARN(
+                    "[SQLResolver] Could not allocate statement for: %s",
+                    query.c_str());
+                return nullptr;
+            }
+            if (mysql_stmt_prepare(statement, query.c_str(), query.size()) ==
+                0) {
+                TF_DEBUG(USD_URI_SQL_RESOLVER)
+                    .Msg("MySQLSession::execute: prepared statement\n");
+            } else {
+                const auto error = mysql_stmt_errno(statement);
+                SQL_WARN(
+                    "[SQLResolver] Error preparing statement: %s\nError "
+                    "code: %i\nError string: %s",
+                    query.c_str(), error, mysql_stmt_error(statement));
+                mysql_stmt_close(statement);
+                statement = nullptr;
+                if (attempt == 0 && needs_reprepare(error)) {
+                    reset_statements(error);
+                    continue;
+                }
+                return nullptr;
+            }
+        }
+        if (mysql_stmt_bind_param(statement, params) == 0 &&
+            mysql_stmt_execute(statement) == 0) {
+            return statement;
+        }
+        const auto error = mysql_stmt_errno(statement);
+        if (attempt == 0 && needs_reprepare(error)) {
+            TF_DEBUG(USD_URI_SQL_RESOLVER)
+                .Msg(
+                    "MySQLSession::execute: connection lost, preparing "
+                    "statements again\n");
+            reset_statements(error);
+            continue;
+        }
+        SQL_WARN(
+            "[SQLResolver] Error executing statement: %s\nError code: "
+            "%i\nError string: %s",
+            query.c_str(), error, mysql_stmt_error(statement));
+        return nullptr;
+    }
+    return nullptr;
+}
+
+MYSQL_STMT* MySQLSession::execute_batch(
+    StatementKind kind, const TfToken* paths, size_t count) {
+    std::array<MYSQL_BIND, QUERY_BATCH_SIZE> params;
+    for (size_t i = 0; i < QUERY_BATCH_SIZE; ++i) {
+        params[i] = bind_string(paths[std::min(i, count - 1)].GetString());
+    }
+    return execute(kind, params.data());
+}
+
+std::shared_ptr<ArAsset> MySQLSession::fetch_chunked(
+    const TfToken& asset_path, double timestamp, size_t size) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "SQLConnection::open_asset: fetching %zu bytes of '%s' in "
+            "chunks\n",
+            size, asset_path.GetText());
+    char header[COMPRESSION_HEADER_SIZE];
+    const auto header_size = std::min(COMPRESSION_HEADER_SIZE, size);
+    if (!fetch_range(asset_path, timestamp, 0, header_size, header)) {
+        return nullptr;
+    }
+    // Compressed data is decompressed once downloaded as a whole.
+    if (is_compressed(header, header_size)) {
+        const auto decompressed =
+            checked_decompressed_size(header, header_size);
+        if (decompressed == 0) { return nullptr; }
+        std::vector<char> compressed(size);
+        if (!fetch_chunks(asset_path, timestamp, size, compressed.data())) {
+            return nullptr;
+        }
+        return decompress_asset(compressed, decompressed);
+    }
+
+    int fd = -1;
+    auto data = allocate_buffer(size, fd);
+    if (data == nullptr) { return nullptr; }
+    if (!fetch_chunks(asset_path, timestamp, size, data.get())) {
+        close_asset_fd(fd);
+        return nullptr;
+    }
+    return std::make_shared<MemoryAsset>(std::move(data), size, fd);
+}
+
+bool MySQLSession::fetch_chunks(
+    const TfToken& asset_path, double timestamp, size_t size, char* buffer) {
+    for (size_t offset = 0; offset < size; offset += FETCH_CHUNK_SIZE) {
+        if (!fetch_range(
+                asset_path, timestamp, offset,
+                std::min(FETCH_CHUNK_SIZE, size - offset), buffer + offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ResolveResult MySQLSession::resolve(
+    const TfToken& asset_path, double& timestamp, size_t& size) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLConnection::find_asset: querying '%s'\n", asset_path.GetText());
+    auto param = bind_string(asset_path.GetString());
+    auto* statement = execute(STATEMENT_RESOLVE, &param);
+    if (statement == nullptr) { return RESOLVE_FAILED; }
+    StatementResult result(statement);
+
+    MYSQL_TIME time;
+    my_bool time_is_null = 0;
+    unsigned long long data_size = 0;
+    my_bool size_is_null = 0;
+    MYSQL_BIND columns[2] = {
+        bind_time(time, time_is_null), bind_size(data_size, size_is_null)};
+    if (mysql_stmt_bind_result(statement, columns) != 0 ||
+        !fetch_row(statement)) {
+        // No error means there was no row.
+        return mysql_stmt_errno(statement) == 0 ? RESOLVE_MISSING
+                                                : RESOLVE_FAILED;
+    }
+    timestamp = time_is_null ? INVALID_TIME : convert_mysql_time(time);
+    size = size_is_null ? 0 : static_cast<size_t>(data_size);
+    return RESOLVE_FOUND;
+}
+
+double MySQLSession::get_timestamp(const TfToken& asset_path) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("get_timestamp_raw: '%s'\n", asset_path.GetText());
+    auto param = bind_string(asset_path.GetString());
+    auto* statement = execute(STATEMENT_TIMESTAMP, &param);
+    if (statement == nullptr) { return INVALID_TIME; }
+    StatementResult result(statement);
+
+    MYSQL_TIME time;
+    my_bool is_null = 0;
+    auto column = bind_time(time, is_null);
+    if (mysql_stmt_bind_result(statement, &column) != 0 ||
+        !fetch_row(statement)) {
+        return INVALID_TIME;
+    }
+    if (is_null) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg("get_timestamp_raw: failed to convert timestamp\n");
+        return INVALID_TIME;
+    }
+    const auto stamp = convert_mysql_time(time);
+    TF_DEBUG(USD_URI_SQL_RESOLVER).Msg("get_timestamp_raw: got: %f\n", stamp);
+    return stamp;
+}
+
+std::shared_ptr<ArAsset> MySQLSession::fetch(
+    const TfToken& asset_path, double& timestamp) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLConnection::open_asset: fetching '%s'\n", asset_path.GetText());
+    auto param = bind_string(asset_path.GetString());
+    auto* statement = execute(STATEMENT_DATA, &param);
+    if (statement == nullptr) { return nullptr; }
+    auto result = RESOLVE_FAILED;
+    size_t chunked_size = 0;
+    auto asset = read_asset_row(statement, timestamp, result, chunked_size);
+    if (chunked_size > 0) {
+        asset = fetch_chunked(asset_path, timestamp, chunked_size);
+    }
+    return asset;
+}
+
+ResolveResult MySQLSession::fetch_if_newer(
+    const TfToken& asset_path, double since, std::shared_ptr<ArAsset>& asset,
+    double& timestamp) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "SQLConnection::open_asset: fetching '%s' if changed\n",
+            asset_path.GetText());
+    // The server can only compare timestamps that convert back exactly.
+    MYSQL_TIME since_param;
+    if (!convert_to_mysql_time(since, since_param)) { return RESOLVE_FAILED; }
+    MYSQL_BIND params[2] = {bind_string(asset_path.GetString()), {}};
+    params[1].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    params[1].buffer = &since_param;
+    auto* statement = execute(STATEMENT_DATA_IF_NEWER, params);
+    if (statement == nullptr) { return RESOLVE_FAILED; }
+    auto result = RESOLVE_FAILED;
+    size_t chunked_size = 0;
+    asset = read_asset_row(statement, timestamp, result, chunked_size);
+    if (chunked_size > 0) {
+        asset = fetch_chunked(asset_path, timestamp, chunked_size);
+        if (asset == nullptr) { result = RESOLVE_FAILED; }
+    }
+    return result;
+}
+
+bool MySQLSession::fetch_range(
+    const TfToken& asset_path, double timestamp, size_t offset, size_t size,
+    char* buffer) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "fetch_range_raw: '%s' %zu bytes at %zu\n", asset_path.GetText(),
+            size, offset);
+    unsigned long long range_offset = offset;
+    unsigned long long range_size = size;
+    my_bool not_null = 0;
+    MYSQL_BIND params[3] = {
+        bind_size(range_offset, not_null), bind_size(range_size, not_null),
+        bind_string(asset_path.GetString())};
+    auto* statement = execute(STATEMENT_RANGE, params);
+    if (statement == nullptr) { return false; }
+    StatementResult result(statement);
+
+    unsigned long data_length = 0;
+    my_bool data_is_null = 0;
+    MYSQL_TIME time;
+    my_bool time_is_null = 0;
+    MYSQL_BIND columns[2] = {};
+    columns[0].buffer_type = MYSQL_TYPE_BLOB;
+    columns[0].length = &data_length;
+    columns[0].is_null = &data_is_null;
+    columns[1] = bind_time(time, time_is_null);
+    if (mysql_stmt_bind_result(statement, columns) != 0 ||
+        !fetch_row(statement)) {
+        return false;
+    }
+    if (data_is_null || time_is_null ||
+        convert_mysql_time(time) != timestamp || data_length != size) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "fetch_range_raw: '%s' changed since it was opened\n",
+                asset_path.GetText());
+        return false;
+    }
+    return fetch_column(statement, 0, buffer, data_length);
+}
+
+bool MySQLSession::hash(
+    const TfToken& asset_path, std::string& hash, double& timestamp) {
+    auto param = bind_string(asset_path.GetString());
+    auto* statement = execute(STATEMENT_HASH, &param);
+    if (statement == nullptr) { return false; }
+    StatementResult result(statement);
+
+    unsigned long hash_length = 0;
+    my_bool hash_is_null = 0;
+    MYSQL_TIME time;
+    my_bool time_is_null = 0;
+    MYSQL_BIND columns[2] = {{}, bind_time(time, time_is_null)};
+    columns[0].buffer_type = MYSQL_TYPE_STRING;
+    columns[0].length = &hash_length;
+    columns[0].is_null = &hash_is_null;
+    if (mysql_stmt_bind_result(statement, columns) != 0 ||
+        !fetch_row(statement) || hash_is_null || time_is_null) {
+        return false;
+    }
+    hash.resize(hash_length);
+    timestamp = convert_mysql_time(time);
+    return hash_length > 0 &&
+           fetch_column(statement, 0, &hash[0], hash_length);
+}
+
+void MySQLSession::resolve_batch(
+    const std::vector<TfToken>& asset_paths,
+    const ResolveCallback& on_result) {
+    std::unordered_set<std::string> reported;
+    for (size_t first = 0; first < asset_paths.size();
+         first += QUERY_BATCH_SIZE) {
+        const auto count =
+            std::min(QUERY_BATCH_SIZE, asset_paths.size() - first);
+        auto* statement = execute_batch(
+            STATEMENT_RESOLVE_BATCH, asset_paths.data() + first, count);
+        if (statement == nullptr) { continue; }
+        StatementResult result(statement);
+
+        unsigned long path_length = 0;
+        MYSQL_TIME time;
+        my_bool time_is_null = 0;
+        unsigned long long data_size = 0;
+        my_bool size_is_null = 0;
+        MYSQL_BIND columns[3] = {
+            {}, bind_time(time, time_is_null),
+            bind_size(data_size, size_is_null)};
+        columns[0].buffer_type = MYSQL_TYPE_STRING;
+        columns[0].length = &path_length;
+        if (mysql_stmt_bind_result(statement, columns) != 0) { continue; }
+        std::string path;
+        while (fetch_row(statement)) {
+            path.resize(path_length);
+            if (!fetch_column(statement, 0, &path[0], path_length) ||
+                !reported.insert(path).second) {
+                continue;
+            }
+            on_result(
+                path, RESOLVE_FOUND,
+                time_is_null ? INVALID_TIME : convert_mysql_time(time),
+                size_is_null ? 0 : static_cast<size_t>(data_size));
+        }
+        // Only trust the missing rows if the whole batch was read.
+        if (mysql_stmt_errno(statement) != 0) { continue; }
+        for (size_t i = first; i < first + count; ++i) {
+            const auto& missing = asset_paths[i].GetString();
+            if (reported.insert(missing).second) {
+                on_result(missing, RESOLVE_MISSING, INVALID_TIME, 0);
+            }
+        }
+    }
+}
+
+void MySQLSession::fetch_batch(
+    const std::vector<TfToken>& asset_paths,
+    const FetchCallback& on_fetched) {
+    std::unordered_set<std::string> reported;
+    // Large blobs are downloaded once the batch statement is done.
+    struct Chunked {
+        std::string path;
+        double timestamp;
+        size_t size;
+    };
+    std::vector<Chunked> chunked;
+    for (size_t first = 0; first < asset_paths.size();
+         first += QUERY_BATCH_SIZE) {
+        auto* statement = execute_batch(
+            STATEMENT_DATA_BATCH, asset_paths.data() + first,
+            std::min(QUERY_BATCH_SIZE, asset_paths.size() - first));
+        if (statement == nullptr) { continue; }
+        StatementResult result(statement);
+
+        unsigned long path_length = 0;
+        unsigned long data_length = 0;
+        my_bool data_is_null = 0;
+        unsigned long long size = 0;
+        my_bool size_is_null = 0;
+        MYSQL_TIME time;
+        my_bool time_is_null = 0;
+        MYSQL_BIND columns[4] = {
+            {}, {}, bind_size(size, size_is_null),
+            bind_time(time, time_is_null)};
+        columns[0].buffer_type = MYSQL_TYPE_STRING;
+        columns[0].length = &path_length;
+        columns[1].buffer_type = MYSQL_TYPE_BLOB;
+        columns[1].length = &data_length;
+        columns[1].is_null = &data_is_null;
+        if (mysql_stmt_bind_result(statement, columns) != 0) { continue; }
+        std::string path;
+        while (fetch_row(statement)) {
+            path.resize(path_length);
+            if (size_is_null ||
+                !fetch_column(statement, 0, &path[0], path_length) ||
+                reported.count(path) != 0) {
+                continue;
+            }
+            reported.insert(path);
+            const auto timestamp =
+                time_is_null ? INVALID_TIME : convert_mysql_time(time);
+            if (data_is_null) {
+                chunked.push_back({path, timestamp, static_cast<size_t>(size)});
+                continue;
+            }
+            auto asset = fetch_blob_column(statement, 1, data_length);
+            if (asset == nullptr) {
+                reported.erase(path);
+                continue;
+            }
+            on_fetched(path, asset, timestamp);
+        }
+    }
+    for (const auto& entry : chunked) {
+        auto asset =
+            fetch_chunked(TfToken(entry.path), entry.timestamp, entry.size);
+        if (asset != nullptr) {
+            on_fetched(entry.path, asset, entry.timestamp);
+        }
+    }
+}
+
+void MySQLSession::hash_batch(
+    const std::vector<TfToken>& asset_paths, const HashCallback& on_hash) {
+    for (size_t first = 0; first < asset_paths.size();
+         first += QUERY_BATCH_SIZE) {
+        auto* statement = execute_batch(
+            STATEMENT_HASH_BATCH, asset_paths.data() + first,
+            std::min(QUERY_BATCH_SIZE, asset_paths.size() - first));
+        if (statement == nullptr) { continue; }
+        StatementResult result(statement);
+
+        unsigned long path_length = 0;
+        unsigned long hash_length = 0;
+        my_bool hash_is_null = 0;
+        MYSQL_TIME time;
+        my_bool time_is_null = 0;
+        MYSQL_BIND columns[3] = {{}, {}, bind_time(time, time_is_null)};
+        columns[0].buffer_type = MYSQL_TYPE_STRING;
+        columns[0].length = &path_length;
+        columns[1].buffer_type = MYSQL_TYPE_STRING;
+        columns[1].length = &hash_length;
+        columns[1].is_null = &hash_is_null;
+        if (mysql_stmt_bind_result(statement, columns) != 0) { continue; }
+        std::string path;
+        std::string hash;
+        while (fetch_row(statement)) {
+            if (hash_is_null || time_is_null || hash_length == 0) { continue; }
+            path.resize(path_length);
+            hash.resize(hash_length);
+            if (!fetch_column(statement, 0, &path[0], path_length) ||
+                !fetch_column(statement, 1, &hash[0], hash_length)) {
+                continue;
+            }
+            on_hash(path, hash, convert_mysql_time(time));
+        }
+    }
+}
+
+bool MySQLSession::latest_change(double& high_water) {
+    auto* statement = execute(STATEMENT_LATEST_CHANGE, nullptr);
+    if (statement == nullptr) { return false; }
+    StatementResult result(statement);
+
+    MYSQL_TIME time;
+    my_bool is_null = 0;
+    auto column = bind_time(time, is_null);
+    if (mysql_stmt_bind_result(statement, &column) != 0 ||
+        !fetch_row(statement)) {
+        return false;
+    }
+    // An empty table has no latest change.
+    if (!is_null) { high_water = convert_mysql_time(time); }
+    return true;
+}
+
+bool MySQLSession::changes(
+    double& high_water, const ChangeCallback& on_change) {
+    // Rows changed in the same second are returned again anyway, so whole
+    // seconds are enough, and always convert.
+    MYSQL_TIME since;
+    if (!convert_to_mysql_time(std::floor(high_water), since)) {
+        return false;
+    }
+    MYSQL_BIND param = {};
+    param.buffer_type = MYSQL_TYPE_TIMESTAMP;
+    param.buffer = &since;
+    auto* statement = execute(STATEMENT_CHANGES, &param);
+    if (statement == nullptr) { return false; }
+    StatementResult result(statement);
+
+    unsigned long path_length = 0;
+    MYSQL_TIME time;
+    my_bool time_is_null = 0;
+    MYSQL_BIND columns[2] = {{}, bind_time(time, time_is_null)};
+    columns[0].buffer_type = MYSQL_TYPE_STRING;
+    columns[0].length = &path_length;
+    if (mysql_stmt_bind_result(statement, columns) != 0) { return false; }
+    std::string path;
+    while (fetch_row(statement)) {
+        path.resize(path_length);
+        if (time_is_null ||
+            !fetch_column(statement, 0, &path[0], path_length)) {
+            continue;
+        }
+        const auto stamp = convert_mysql_time(time);
+        if (stamp > high_water) { high_water = stamp; }
+        on_change(path, stamp);
+    }
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<Backend> make_mysql_backend(
+    const std::string& server_name, const std::string& table_name,
+    const std::string& hash_column) {
+    my_init();
+    ServerConfig server;
+    server.name = server_name;
+    server.user = get_env_var(server_name, USER_ENV_VAR, "root");
+    const auto compacted_default_pass =
+        z85::encode_with_padding(std::string("12345678"));
+    server.password = z85::decode_with_padding(
+        get_env_var(server_name, PASSWORD_ENV_VAR, compacted_default_pass));
+    server.db = get_env_var(server_name, DB_ENV_VAR, "usd");
+    server.port = static_cast<unsigned int>(
+        atoi(get_env_var(server_name, PORT_ENV_VAR, "3306").c_str()));
+    const auto pool_size = static_cast<size_t>(std::max(
+        1, atoi(get_env_var(server_name, POOL_SIZE_ENV_VAR, "4").c_str())));
+    std::shared_ptr<const StatementQueries> queries =
+        std::make_shared<StatementQueries>(
+            make_statement_queries(table_name, hash_column));
+    return std::unique_ptr<Backend>(new Backend(
+        server_name, pool_size,
+        [server, queries]() -> std::unique_ptr<Backend::Session> {
+            auto* connection = open_connection(server);
+            if (connection == nullptr) { return nullptr; }
+            return std::unique_ptr<Backend::Session>(
+                new MySQLSession(connection, queries));
+        }));
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <memory>
+#include <string>
+
+#include "backend.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Backend reading the assets from a MySQL server, using prepared statements.
+// The hash queries are only prepared if hash_column is not empty.
+std::unique_ptr<Backend> make_mysql_backend(
+    const std::string& server_name, const std::string& table_name,
+    const std::string& hash_column);
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,19 @@
+#pragma once
+
+// Conversions of the MySQL backend, shared with the benchmarks.
+
+#include <pxr/pxr.h>
+
+#include <my_global.h>
+#include <mysql.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Converts a DATETIME or TIMESTAMP column to seconds since the epoch, reading
+// it as local time without daylight saving.
+double convert_mysql_time(const MYSQL_TIME& time);
+// The inverse of convert_mysql_time, returns false if the result does not
+// convert back to the same timestamp.
+bool convert_to_mysql_time(double timestamp, MYSQL_TIME& time);
+
+PXR_NAMESPACE_CLOSE_SCOPE
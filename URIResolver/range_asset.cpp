@@ -0,0 +1,163 @@
+#include "range_asset.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "memory_asset.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = RANGE_BLOCK_SIZE;
+// Number of extra blocks fetched when reading sequentially.
+constexpr size_t READ_AHEAD_BLOCKS = 4;
+
+std::shared_ptr<char> allocate(size_t size) {
+    auto* d = static_cast<char*>(malloc(size));
+    if (d == nullptr) { return nullptr; }
+    return std::shared_ptr<char>(d, [](char* p) { free(p); });
+}
+
+} // namespace
+
+RangeAsset::RangeAsset(
+    size_t size, FetchFunction fetch, std::shared_ptr<char> first_block)
+    : data_size(size),
+      fetch(std::move(fetch)),
+      blocks((size + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+    if (!blocks.empty()) {
+        blocks.front() = std::move(first_block);
+        // Reading on from the first block counts as sequential.
+        if (blocks.front() != nullptr) { next_block = 1; }
+    }
+}
+
+size_t RangeAsset::_GetSize() const { return data_size; }
+
+std::shared_ptr<const char> RangeAsset::_GetBuffer() const {
+    auto materialized = _Materialize();
+    if (materialized == nullptr) { return nullptr; }
+    return materialized->GetBuffer();
+}
+
+size_t RangeAsset::_Read(void* buffer, size_t count, size_t offset) const {
+    if (offset >= data_size) { return 0; }
+    count = std::min(data_size - offset, count);
+    if (count == 0) { return 0; }
+
+    const auto first = offset / BLOCK_SIZE;
+    const auto last = (offset + count - 1) / BLOCK_SIZE;
+    std::shared_ptr<MemoryAsset> materialized;
+    std::vector<std::shared_ptr<char>> read_blocks;
+    auto fetch_first = first;
+    auto fetch_last = last;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        materialized = whole;
+        if (materialized == nullptr) {
+            if (first == next_block || first + 1 == next_block) {
+                fetch_last =
+                    std::min(last + READ_AHEAD_BLOCKS, blocks.size() - 1);
+            }
+            next_block = last + 1;
+            read_blocks.assign(
+                blocks.begin() + first, blocks.begin() + last + 1);
+            // Only the blocks at the ends are skipped, so a single fetch
+            // covers the range, even if some blocks in the middle are cached
+            // already.
+            while (fetch_first <= fetch_last && blocks[fetch_first]) {
+                ++fetch_first;
+            }
+            while (fetch_last > fetch_first && blocks[fetch_last]) {
+                --fetch_last;
+            }
+        }
+    }
+    if (materialized != nullptr) {
+        return materialized->Read(buffer, count, offset);
+    }
+
+    if (fetch_first <= fetch_last) {
+        auto fetched = _FetchBlocks(fetch_first, fetch_last);
+        if (fetched.empty()) {
+            // Only fails the read if a block it needs is missing.
+            for (const auto& block : read_blocks) {
+                if (block == nullptr) { return 0; }
+            }
+        } else {
+            for (auto block = std::max(first, fetch_first);
+                 block <= std::min(last, fetch_last); ++block) {
+                read_blocks[block - first] = fetched[block - fetch_first];
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            // Nothing to keep if the whole data arrived in the meantime.
+            if (whole == nullptr) {
+                for (auto block = fetch_first; block <= fetch_last; ++block) {
+                    if (blocks[block] == nullptr) {
+                        blocks[block] = std::move(fetched[block - fetch_first]);
+                    }
+                }
+            }
+        }
+    }
+
+    auto* out = static_cast<char*>(buffer);
+    for (auto block = first; block <= last; ++block) {
+        const auto block_start = block * BLOCK_SIZE;
+        const auto from = std::max(offset, block_start);
+        const auto to = std::min(offset + count, block_start + BLOCK_SIZE);
+        memcpy(
+            out + (from - offset),
+            read_blocks[block - first].get() + (from - block_start),
+            to - from);
+    }
+    return count;
+}
+
+std::pair<FILE*, size_t> RangeAsset::_GetFileUnsafe() const {
+    auto materialized = _Materialize();
+    if (materialized == nullptr) { return {nullptr, 0}; }
+    return materialized->GetFileUnsafe();
+}
+
+std::vector<std::shared_ptr<char>> RangeAsset::_FetchBlocks(
+    size_t first, size_t last) const {
+    const auto start = first * BLOCK_SIZE;
+    const auto size = std::min(data_size, (last + 1) * BLOCK_SIZE) - start;
+    auto buffer = allocate(size);
+    if (buffer == nullptr || !fetch(start, size, buffer.get())) { return {}; }
+    std::vector<std::shared_ptr<char>> ret;
+    ret.reserve(last - first + 1);
+    for (auto block = first; block <= last; ++block) {
+        ret.emplace_back(buffer, buffer.get() + (block - first) * BLOCK_SIZE);
+    }
+    return ret;
+}
+
+std::shared_ptr<MemoryAsset> RangeAsset::_Materialize() const {
+    std::lock_guard<std::mutex> materialize_lock(materialize_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (whole != nullptr) { return whole; }
+    }
+    if (data_size == 0) { return nullptr; }
+    // The file handed out by the MemoryAsset shares the pages of the buffer.
+    int fd = -1;
+    auto buffer = allocate_asset_buffer(data_size, fd);
+    if (buffer == nullptr || !fetch(0, data_size, buffer.get())) {
+        close_asset_fd(fd);
+        return nullptr;
+    }
+    auto materialized =
+        std::make_shared<MemoryAsset>(std::move(buffer), data_size, fd);
+    std::lock_guard<std::mutex> lock(mutex);
+    whole = materialized;
+    blocks.clear();
+    blocks.shrink_to_fit();
+    return materialized;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <pxr/usd/ar/asset.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class MemoryAsset;
+
+// Reads are rounded to blocks of this many bytes.
+constexpr size_t RANGE_BLOCK_SIZE = 64 * 1024;
+
+// Asset that only downloads the parts of the data that are read. Reads are
+// rounded to whole blocks, which are kept for later reads, and sequential
+// reads fetch a few blocks ahead. The whole data is only downloaded when the
+// buffer or the file is requested.
+class RangeAsset final : public ArAsset {
+public:
+    // Fills buffer with size bytes starting at offset, returns false if the
+    // data is not available anymore.
+    using FetchFunction =
+        std::function<bool(size_t offset, size_t size, char* buffer)>;
+
+    // The first block can be handed over if it was read already, it has to
+    // hold min(size, RANGE_BLOCK_SIZE) bytes.
+    RangeAsset(
+        size_t size, FetchFunction fetch,
+        std::shared_ptr<char> first_block = nullptr);
+    ~RangeAsset() override = default;
+
+    RangeAsset(const RangeAsset&) = delete;
+    RangeAsset(RangeAsset&&) = delete;
+    RangeAsset& operator=(const RangeAsset&) = delete;
+    RangeAsset& operator=(RangeAsset&&) = delete;
+
+#if AR_VERSION == 2
+    size_t GetSize() const override { return _GetSize(); }
+    std::shared_ptr<const char> GetBuffer() const override {
+        return _GetBuffer();
+    };
+    size_t Read(void* buffer, size_t count, size_t offset) const override {
+        return _Read(buffer, count, offset);
+    };
+    std::pair<FILE*, size_t> GetFileUnsafe() const override {
+        return _GetFileUnsafe();
+    };
+#else
+    size_t GetSize() override { return _GetSize(); }
+    std::shared_ptr<const char> GetBuffer() override {
+        return _GetBuffer();
+    };
+    size_t Read(void* buffer, size_t count, size_t offset) override {
+        return _Read(buffer, count, offset);
+    };
+    std::pair<FILE*, size_t> GetFileUnsafe() override {
+        return _GetFileUnsafe();
+    };
+#endif
+
+private:
+    size_t _GetSize() const;
+    std::shared_ptr<const char> _GetBuffer() const;
+    size_t _Read(void* buffer, size_t count, size_t offset) const;
+    std::pair<FILE*, size_t> _GetFileUnsafe() const;
+
+    // Downloads the blocks in [first, last], without holding the mutex.
+    // Returns no blocks if the download failed.
+    std::vector<std::shared_ptr<char>> _FetchBlocks(
+        size_t first, size_t last) const;
+    // Downloads the whole data, once.
+    std::shared_ptr<MemoryAsset> _Materialize() const;
+
+    size_t data_size;
+    FetchFunction fetch;
+    // Guards the blocks and the whole data, never held while downloading.
+    mutable std::mutex mutex;
+    // Only one thread downloads the whole data.
+    mutable std::mutex materialize_mutex;
+    // Blocks share the buffer of the fetch that downloaded them.
+    mutable std::vector<std::shared_ptr<char>> blocks;
+    // One past the last block read, to detect sequential reads.
+    mutable size_t next_block = 0;
+    // The whole data, once requested. Replaces the blocks.
+    mutable std::shared_ptr<MemoryAsset> whole;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
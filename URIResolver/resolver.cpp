@@ -1,6 +1,7 @@
 #include "resolver.h"
 
 #include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/trace/trace.h>
 
 #include <pxr/usd/ar/assetInfo.h>
 #include <pxr/usd/ar/resolverContext.h>
@@ -37,10 +38,38 @@ URIResolver::URIResolver() : ArDefaultResolver() {}
 URIResolver::~URIResolver() { /*g_sql.clear();*/
 }
 
+URIResolver::_ScopeData URIResolver::_GetScopeData(
+    const VtValue* cacheScopeData) {
+    return cacheScopeData->IsHolding<_ScopeData>()
+               ? cacheScopeData->UncheckedGet<_ScopeData>()
+               : _ScopeData();
+}
+
+void URIResolver::_BeginSqlCacheScope(_ScopeData& scopeData) {
+    _sqlCaches.BeginCacheScope(&scopeData.sqlData);
+}
+
+void URIResolver::_EndSqlCacheScope(_ScopeData& scopeData) {
+    _sqlCaches.EndCacheScope(&scopeData.sqlData);
+}
+
+// Inside a cache scope every sql: path is only resolved, and its timestamp
+// only checked, once.
 bool URIResolver::_ResolveSql(
     const std::string& assetPath, std::string& resolvedPath) const {
     if (SQL.matches_schema(assetPath)) {
-        resolvedPath = SQL.find_asset(assetPath);
+        const auto cache = _sqlCaches.GetCurrentCache();
+        if (cache == nullptr) {
+            resolvedPath = SQL.find_asset(assetPath);
+            return true;
+        }
+        const auto it = cache->resolvedPaths.find(assetPath);
+        if (it != cache->resolvedPaths.end()) {
+            resolvedPath = it->second;
+        } else {
+            resolvedPath = SQL.find_asset(assetPath);
+            cache->resolvedPaths.insert({assetPath, resolvedPath});
+        }
         return true;
     }
     return false;
@@ -49,7 +78,18 @@ bool URIResolver::_ResolveSql(
 bool URIResolver::_GetTimestampSql(
     const std::string& assetPath, double& timestamp) const {
     if (SQL.matches_schema(assetPath)) {
-        timestamp = SQL.get_timestamp(assetPath);
+        const auto cache = _sqlCaches.GetCurrentCache();
+        if (cache == nullptr) {
+            timestamp = SQL.get_timestamp(assetPath);
+            return true;
+        }
+        const auto it = cache->timestamps.find(assetPath);
+        if (it != cache->timestamps.end()) {
+            timestamp = it->second;
+        } else {
+            timestamp = SQL.get_timestamp(assetPath);
+            cache->timestamps.insert({assetPath, timestamp});
+        }
         return true;
     }
     return false;
@@ -66,6 +106,7 @@ bool URIResolver::_OpenSqlAsset(
 
 #if AR_VERSION == 2
 ArResolvedPath URIResolver::_Resolve(const std::string& assetPath) const {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER).Msg("_Resolve('%s')\n", assetPath.c_str());
     std::string resolvedPath;
     if (_ResolveSql(assetPath, resolvedPath)) {
@@ -76,6 +117,7 @@ ArResolvedPath URIResolver::_Resolve(const std::string& assetPath) const {
 
 ArResolvedPath URIResolver::_ResolveForNewAsset(
     const std::string& assetPath) const {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER)
         .Msg("_ResolveForNewAsset('%s')\n", assetPath.c_str());
     std::string resolvedPath;
@@ -100,6 +142,7 @@ std::string URIResolver::_CreateIdentifierForNewAsset(
 
 ArTimestamp URIResolver::_GetModificationTimestamp(
     const std::string& assetPath, const ArResolvedPath& resolvedPath) const {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER)
         .Msg(
             "GetModificationTimestamp('%s', '%s')\n", assetPath.c_str(),
@@ -114,6 +157,7 @@ ArTimestamp URIResolver::_GetModificationTimestamp(
 
 std::shared_ptr<ArAsset> URIResolver::_OpenAsset(
     const ArResolvedPath& resolvedPath) const {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER).Msg(
             "OpenAsset('%s')\n", resolvedPath.GetPathString());
     std::shared_ptr<ArAsset> asset;
@@ -123,6 +167,22 @@ std::shared_ptr<ArAsset> URIResolver::_OpenAsset(
     return ArDefaultResolver::_OpenAsset(resolvedPath);
 }
 
+void URIResolver::_BeginCacheScope(VtValue* cacheScopeData) {
+    TF_DEBUG(USD_URI_RESOLVER).Msg("_BeginCacheScope()\n");
+    auto scopeData = _GetScopeData(cacheScopeData);
+    ArDefaultResolver::_BeginCacheScope(&scopeData.defaultData);
+    _BeginSqlCacheScope(scopeData);
+    *cacheScopeData = scopeData;
+}
+
+void URIResolver::_EndCacheScope(VtValue* cacheScopeData) {
+    TF_DEBUG(USD_URI_RESOLVER).Msg("_EndCacheScope()\n");
+    auto scopeData = _GetScopeData(cacheScopeData);
+    ArDefaultResolver::_EndCacheScope(&scopeData.defaultData);
+    _EndSqlCacheScope(scopeData);
+    *cacheScopeData = scopeData;
+}
+
 #else
 std::string URIResolver::Resolve(const std::string& path) {
     TF_DEBUG(USD_URI_RESOLVER).Msg("Resolve('%s')\n", path.c_str());
@@ -136,6 +196,7 @@ bool URIResolver::IsRelativePath(const std::string& path) {
 
 std::string URIResolver::ResolveWithAssetInfo(
     const std::string& path, ArAssetInfo* assetInfo) {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER)
         .Msg("ResolveWithAssetInfo('%s')\n", path.c_str());
     std::string resolvedPath;
@@ -167,6 +228,7 @@ std::string URIResolver::AnchorRelativePath(
 
 VtValue URIResolver::GetModificationTimestamp(
     const std::string& path, const std::string& resolvedPath) {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER)
         .Msg(
             "GetModificationTimestamp('%s', '%s')\n", path.c_str(),
@@ -192,6 +254,7 @@ bool URIResolver::FetchToLocalResolvedPath(
 
 std::shared_ptr<ArAsset> URIResolver::OpenAsset(
     const std::string& resolvedPath) {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_RESOLVER).Msg("OpenAsset('%s')\n", resolvedPath.c_str());
     std::shared_ptr<ArAsset> asset;
     if (_OpenSqlAsset(resolvedPath, asset)) {
@@ -199,6 +262,22 @@ std::shared_ptr<ArAsset> URIResolver::OpenAsset(
     }
     return ArDefaultResolver::OpenAsset(resolvedPath);
 }
+
+void URIResolver::BeginCacheScope(VtValue* cacheScopeData) {
+    TF_DEBUG(USD_URI_RESOLVER).Msg("BeginCacheScope()\n");
+    auto scopeData = _GetScopeData(cacheScopeData);
+    ArDefaultResolver::BeginCacheScope(&scopeData.defaultData);
+    _BeginSqlCacheScope(scopeData);
+    *cacheScopeData = scopeData;
+}
+
+void URIResolver::EndCacheScope(VtValue* cacheScopeData) {
+    TF_DEBUG(USD_URI_RESOLVER).Msg("EndCacheScope()\n");
+    auto scopeData = _GetScopeData(cacheScopeData);
+    ArDefaultResolver::EndCacheScope(&scopeData.defaultData);
+    _EndSqlCacheScope(scopeData);
+    *cacheScopeData = scopeData;
+}
 #endif
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <pxr/usd/ar/defaultResolver.h>
+#include <pxr/usd/ar/threadLocalScopedCache.h>
 
+#include <tbb/concurrent_unordered_map.h>
 #include <tbb/enumerable_thread_specific.h>
 
 #include <memory>
@@ -34,6 +36,10 @@ public:
 
     std::shared_ptr<ArAsset> _OpenAsset(
         const ArResolvedPath& resolvedPath) const override;
+
+    void _BeginCacheScope(VtValue* cacheScopeData) override;
+
+    void _EndCacheScope(VtValue* cacheScopeData) override;
 #else
     std::string Resolve(const std::string& path) override;
 
@@ -54,8 +60,40 @@ public:
 
     std::shared_ptr<ArAsset> OpenAsset(
         const std::string& resolvedPath) override;
+
+    void BeginCacheScope(VtValue* cacheScopeData) override;
+
+    void EndCacheScope(VtValue* cacheScopeData) override;
 #endif
 private:
+    // Results of sql: queries inside a cache scope, shared by every thread
+    // using the scope.
+    struct _SqlCache {
+        tbb::concurrent_unordered_map<std::string, std::string> resolvedPaths;
+        tbb::concurrent_unordered_map<std::string, double> timestamps;
+    };
+
+    // USD passes a single value around for each scope, which holds both the
+    // data of ArDefaultResolver and ours.
+    struct _ScopeData {
+        VtValue defaultData;
+        VtValue sqlData;
+
+        bool operator==(const _ScopeData& other) const {
+            return defaultData == other.defaultData &&
+                   sqlData == other.sqlData;
+        }
+        bool operator!=(const _ScopeData& other) const {
+            return !(*this == other);
+        }
+    };
+
+    static _ScopeData _GetScopeData(const VtValue* cacheScopeData);
+
+    void _BeginSqlCacheScope(_ScopeData& scopeData);
+
+    void _EndSqlCacheScope(_ScopeData& scopeData);
+
     bool _ResolveSql(
         const std::string& assetPath, std::string& resolvedPath) const;
 
@@ -64,6 +102,8 @@ private:
 
     bool _OpenSqlAsset(
         const std::string& resolvedPath, std::shared_ptr<ArAsset>& asset) const;
+
+    mutable ArThreadLocalScopedCache<_SqlCache> _sqlCaches;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
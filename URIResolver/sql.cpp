@@ -1,21 +1,32 @@
 #include "sql.h"
 
 #include <pxr/base/tf/diagnosticLite.h>
+#include <pxr/base/trace/trace.h>
 
-#include <my_global.h>
-#include <my_sys.h>
-#include <mysql.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 #include <algorithm>
-#include <iomanip>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <functional>
 #include <limits>
-#include <sstream>
+#include <thread>
 #include <unordered_map>
 
-#include <z85/z85.hpp>
-
+#include "compression.h"
 #include "debug_codes.h"
-#include "memory_asset.h"
+#include "mysql_backend.h"
+#include "range_asset.h"
+#include "sql_internal.h"
+#include "sqlite_backend.h"
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -26,104 +37,89 @@ namespace {
 constexpr auto SQL_PREFIX = "sql://";
 constexpr auto SQL_PREFIX_SHORT = "sql:";
 constexpr auto HOST_ENV_VAR = "USD_SQL_DBHOST";
-constexpr auto PORT_ENV_VAR = "USD_SQL_PORT";
-constexpr auto DB_ENV_VAR = "USD_SQL_DB";
+constexpr auto BACKEND_ENV_VAR = "USD_SQL_BACKEND";
 constexpr auto TABLE_ENV_VAR = "USD_SQL_TABLE";
-constexpr auto USER_ENV_VAR = "USD_SQL_USER";
-constexpr auto PASSWORD_ENV_VAR = "USD_SQL_PASSWD";
-
-constexpr double INVALID_TIME = std::numeric_limits<double>::lowest();
-
-struct MySQLResultDeleter {
-    void operator()(MYSQL_RES* r) const { mysql_free_result(r); }
-};
-using MySQLResult = std::unique_ptr<MYSQL_RES, MySQLResultDeleter>;
+constexpr auto REVALIDATE_ENV_VAR = "USD_SQL_REVALIDATE_MS";
+constexpr auto POLL_ENV_VAR = "USD_SQL_POLL_MS";
+constexpr auto NEGATIVE_TTL_ENV_VAR = "USD_SQL_NEGATIVE_TTL_MS";
+constexpr auto RANGE_THRESHOLD_ENV_VAR = "USD_SQL_RANGE_THRESHOLD";
+constexpr auto CACHE_PATH_ENV_VAR = "USD_SQL_CACHE_PATH";
+constexpr auto MEMORY_BUDGET_ENV_VAR = "USD_SQL_MEMORY_BUDGET_MB";
+constexpr auto HASH_COLUMN_ENV_VAR = "USD_SQL_HASH_COLUMN";
+constexpr auto PREFETCH_ENV_VAR = "USD_SQL_PREFETCH";
+constexpr auto STATS_PATH_ENV_VAR = "USD_SQL_STATS_PATH";
+constexpr auto STATS_SIGNAL_ENV_VAR = "USD_SQL_STATS_SIGNAL";
+
+// How long the timestamp read by a resolve is used without asking again. It
+// only covers the timestamp query that usually follows the resolve.
+constexpr auto FRESH_TIMESTAMP_WINDOW = std::chrono::seconds(1);
 
 using mutex_scoped_lock = std::lock_guard<std::mutex>;
 
-// Included in other source file. For improving readibility it's defined here.
-
-// -----------------------------------------------------------------------------
-// If you want to print out a stacktrace everywhere SQL_WARN is called, set this
-// to a value > 0 - it will print out this number of stacktrace entries
-#define USD_SQL_DEBUG_STACKTRACE_SIZE 0
-
-#if USD_SQL_DEBUG_STACKTRACE_SIZE > 0
-
-#include <execinfo.h>
-
-#define SQL_WARN                                                          \
-    {                                                                     \
-        void* backtrace_array[USD_SQL_DEBUG_STACKTRACE_SIZE];             \
-        size_t stack_size =                                               \
-            backtrace(backtrace_array, USD_SQL_DEBUG_STACKTRACE_SIZE);    \
-        TF_WARN("\n\n====================================\n");            \
-        TF_WARN("Stacktrace:\n");                                         \
-        backtrace_symbols_fd(backtrace_array, stack_size, STDERR_FILENO); \
-    }                                                                     \
-    TF_WARN
-
-#else // STACKTRACE_SIZE
-
-#define SQL_WARN TF_WARN
-
-#endif // STACKTRACE_SIZE
-
-// -----------------------------------------------------------------------------
-
-// If you want to control the number of seconds an idle connection is kept alive
-// for, set this to something other than zero
-
-#define SESSION_WAIT_TIMEOUT 0
-
-#if SESSION_WAIT_TIMEOUT > 0
-
-#define _USD_SQL_SIMPLE_QUOTE(ARG) #ARG
-#define _USD_SQL_EXPAND_AND_QUOTE(ARG) _SIMPLE_QUOTE(ARG)
-#define SET_SESSION_WAIT_TIMEOUT_QUERY                      \
-    ("SET SESSION wait_timeout=" _USD_SQL_EXPAND_AND_QUOTE( \
-        SESSION_WAIT_TIMEOUT))
-#define SET_SESSION_WAIT_TIMEOUT_QUERY_STRLEN \
-    (sizeof(SET_SESSION_WAIT_TIMEOUT_QUERY) - 1)
-
-#endif // SESSION_WAIT_TIMEOUT
-
 // Clang tidy/static analyzer complains about this.
 constexpr size_t cstrlen(const char* str) {
     return *str != 0 ? 1 + cstrlen(str + 1) : 0;
 }
 
-thread_local std::once_flag thread_flag;
-
-void sql_thread_init() {
-    std::call_once(thread_flag, []() { my_thread_init(); });
+template <typename T>
+std::future<T> make_ready_future(T value) {
+    std::promise<T> promise;
+    promise.set_value(std::move(value));
+    return promise.get_future();
 }
 
-std::string get_env_var(
-    const std::string& server_name, const std::string& env_var,
-    const std::string& default_value) {
-    const auto env_first = getenv((server_name + "_" + env_var).c_str());
-    if (env_first != nullptr) { return env_first; }
-    const auto env_second = getenv(env_var.c_str());
-    if (env_second != nullptr) { return env_second; }
-    return default_value;
+// Longest path and most paths picked up from a single layer when prefetching.
+constexpr size_t MAX_PREFETCH_PATH_LENGTH = 4096;
+constexpr size_t MAX_PREFETCH_PATHS = 256;
+
+// Finds the sql: asset paths in the data of a layer, without parsing it. Works
+// for text layers and for the uncompressed strings of crate files.
+std::vector<std::string> scan_sql_paths(const char* data, size_t size) {
+    constexpr auto prefix_length = cstrlen(SQL_PREFIX_SHORT);
+    std::vector<std::string> ret;
+    const auto* end = data + size;
+    const auto* it = data;
+    while (ret.size() < MAX_PREFETCH_PATHS) {
+        it = std::search(
+            it, end, SQL_PREFIX_SHORT, SQL_PREFIX_SHORT + prefix_length);
+        if (it == end) { break; }
+        const auto* path_end = it + prefix_length;
+        while (path_end != end &&
+               static_cast<size_t>(path_end - it) < MAX_PREFETCH_PATH_LENGTH &&
+               strchr("@\"'<>()[],;", *path_end) == nullptr &&
+               static_cast<unsigned char>(*path_end) > ' ') {
+            ++path_end;
+        }
+        std::string path(it, path_end);
+        it = path_end;
+        if (path.find('.') == std::string::npos) { continue; }
+        path = clean_path(path);
+        if (std::find(ret.begin(), ret.end(), path) == ret.end()) {
+            ret.push_back(std::move(path));
+        }
+    }
+    return ret;
 }
 
-template <
-    typename key_t, typename value_t, value_t default_value = value_t(),
-    typename pair_t = std::pair<key_t, value_t>>
-value_t find_in_sorted_vector(
-    const std::vector<pair_t>& vec, const key_t& key) {
-    const auto ret = std::lower_bound(
-        vec.begin(), vec.end(), pair_t{key, default_value},
-        [](const pair_t& a, const pair_t& b) { return a.first < b.first; });
-    if (ret != vec.end() && ret->first == key) {
-        return ret->second;
-    } else {
-        return default_value;
-    }
+#ifndef _WIN32
+
+// The signal handler only wakes up the thread writing the statistics, as
+// writing a pipe is safe in a signal handler, and writing files is not.
+int stats_pipe[2] = {-1, -1};
+
+void stats_signal_handler(int) {
+    const auto saved_errno = errno;
+    const char dump = 1;
+    // If the pipe is full, a dump is pending anyway.
+    const auto ret = write(stats_pipe[1], &dump, 1);
+    (void)ret;
+    errno = saved_errno;
 }
 
+#endif
+
+} // namespace
+
 std::string parse_path(const std::string& path) {
     constexpr auto schema_length_short = cstrlen(SQL_PREFIX_SHORT);
     constexpr auto schema_length = cstrlen(SQL_PREFIX);
@@ -140,150 +136,187 @@ std::string clean_path(const std::string& path) {
          : path;
 }
 
-double convert_char_to_time(const char* raw_time) {
-    std::tm parsed_time = {};
-    std::istringstream ss(raw_time);
-    ss >> std::get_time(&parsed_time, "%Y-%m-%d %H:%M:%S");
-    parsed_time.tm_isdst = 0;
-    // I have to set daylight savings to 0
-    // for the asctime function to match the actual time
-    // even without that, the parsed times will be consistent, so
-    // probably it won't cause any issues
-
-    // The database might use higher resolution, but the posix function is
-    // unable to parse that so we manually have to do it.
-    double ret = mktime(&parsed_time);
-    const auto* dot_pos = strchr(raw_time, '.');
-    if (dot_pos != nullptr && *(dot_pos + 1) != '\0') {
-        char tmp[16];
-        tmp[0] = '0';
-        tmp[1] = '.';
-        strncpy(tmp + 2, dot_pos + 1, 14);
-        ret += atof(tmp);
+AsyncExecutor::~AsyncExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
     }
-    return ret;
+    queue_cv.notify_all();
+    for (auto& thread : threads) { thread.join(); }
 }
 
-double convert_mysql_result_to_time(
-    MYSQL_FIELD* field, MYSQL_ROW row, size_t field_i) {
-    auto ret = INVALID_TIME;
+void AsyncExecutor::worker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) { return; }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
 
-    if (!row) {
-        SQL_WARN("[SQLResolver] row was null");
-    } else if (!field) {
-        SQL_WARN(
-            "[SQLResolver] could not find the field type to retrieve a "
-            "timestamp");
-    } else if (field->type != MYSQL_TYPE_TIMESTAMP) {
-        SQL_WARN(
-            "[SQLResolver] Wrong type for time field. Found %i instead of 7.",
-            field->type);
-    } else if (row[field_i] == nullptr) {
-        SQL_WARN("[SQLResolver] Field %lu was null", field_i);
-    } else if (field->max_length <= 0) {
-        SQL_WARN("[SQLResolver] Field %lu had 0 length", field_i);
-    } else {
-        ret = convert_char_to_time(row[field_i]);
+SQLResolver::SQLResolver() : connections(nullptr) {
+    snapshots.emplace_back(new connection_snapshot());
+    connections.store(snapshots.back().get());
+    const auto* path = getenv(STATS_PATH_ENV_VAR);
+    const auto* signal_number = getenv(STATS_SIGNAL_ENV_VAR);
+    if (path != nullptr) { stats_path = path; }
+    if (!stats_path.empty() && signal_number != nullptr) {
+        stats_signal = atoi(signal_number);
+        start_stats_signal();
     }
-    return ret;
 }
 
-double get_timestamp_raw(
-    MYSQL* connection, const std::string& table_name,
-    const TfToken& asset_path) {
-    constexpr size_t query_max_length = 4096;
-    char query[query_max_length];
-    snprintf(
-        query, query_max_length,
-        "SELECT timestamp FROM %s WHERE path = '%s' LIMIT 1",
-        table_name.c_str(), asset_path.GetText());
-    unsigned long query_length = cstrlen(query);
-    TF_DEBUG(USD_URI_SQL_RESOLVER)
-        .Msg("get_timestamp_raw: query:\n%s\n", query);
-    const auto query_ret = mysql_real_query(connection, query, query_length);
-    // I only have to flush when there is a successful query.
-    MySQLResult result;
-    if (query_ret != 0) {
+SQLResolver::~SQLResolver() {
+    stop_stats_signal();
+    if (!stats_path.empty()) { dump_stats(stats_path); }
+    clear();
+}
+
+void SQLResolver::start_stats_signal() {
+#ifndef _WIN32
+    // We don't take over signals the application handles.
+    struct sigaction current = {};
+    if (stats_signal <= 0 || sigaction(stats_signal, nullptr, &current) != 0 ||
+        current.sa_handler != SIG_DFL) {
         SQL_WARN(
-            "[SQLResolver] Error executing query: %s\nError code: %i\nError "
-            "string: %s",
-            query, mysql_errno(connection), mysql_error(connection));
-    } else {
-        result.reset(mysql_store_result(connection));
+            "[SQLResolver] Signal %i is invalid or already handled, "
+            "statistics are only dumped on exit.",
+            stats_signal);
+        stats_signal = 0;
+        return;
     }
-    if (result == nullptr) { return INVALID_TIME; }
-    if (mysql_num_rows(result.get()) != 1) { return INVALID_TIME; }
-
-    auto row = mysql_fetch_row(result.get());
-    assert(mysql_num_fields(result.get()) == 1);
-    auto field = mysql_fetch_field(result.get());
-    const auto time = convert_mysql_result_to_time(field, row, 0);
-    if (time == INVALID_TIME) {
-        TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg("get_timestamp_raw: failed to convert timestamp\n");
-    } else {
-        TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg("get_timestamp_raw: got: %f\n", time);
+    if (pipe(stats_pipe) != 0) {
+        SQL_WARN("[SQLResolver] Failed creating the statistics pipe.");
+        stats_signal = 0;
+        return;
     }
-    return time;
+    fcntl(stats_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(stats_pipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(stats_pipe[1], F_SETFL, O_NONBLOCK);
+    stats_thread = std::thread([this]() {
+        // A zero byte stops the thread.
+        char command = 0;
+        while (read(stats_pipe[0], &command, 1) == 1 && command != 0) {
+            dump_stats(stats_path);
+        }
+    });
+    struct sigaction action = {};
+    action.sa_handler = stats_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(stats_signal, &action, nullptr);
+#endif
 }
 
-enum CacheState { CACHE_MISSING, CACHE_NEEDS_FETCHING, CACHE_FETCHED };
-
-struct Cache {
-    CacheState state;
-    TfToken local_path;
-    double timestamp;
-    std::shared_ptr<ArAsset> asset;
-};
-
-} // namespace
-
-struct SQLConnection {
-    SQLConnection(const std::string& server_name);
-
-    std::mutex connection_mutex; // do we actually need this? the api should
-                                 // support multithreaded queries!
-    std::unordered_map<TfToken, Cache, TfToken::HashFunctor> cached_queries;
-    std::string table_name;
-    MYSQL* connection;
+void SQLResolver::stop_stats_signal() {
+#ifndef _WIN32
+    if (stats_signal == 0) { return; }
+    signal(stats_signal, SIG_DFL);
+    const char stop = 0;
+    while (write(stats_pipe[1], &stop, 1) != 1 && errno == EAGAIN) {
+        std::this_thread::yield();
+    }
+    stats_thread.join();
+    close(stats_pipe[0]);
+    close(stats_pipe[1]);
+    stats_signal = 0;
+#endif
+}
 
-    bool find_asset(const std::string& asset_path);
-    double get_timestamp(const std::string& asset_path);
-    std::shared_ptr<ArAsset> open_asset(const std::string& asset_path);
-};
+std::vector<SQLServerStats> SQLResolver::get_stats() {
+    std::vector<SQLServerStats> ret;
+    for (const auto& it : *connections.load(std::memory_order_acquire)) {
+        ret.push_back(it.second->get_stats());
+        ret.back().server = it.first;
+    }
+    return ret;
+}
 
-SQLResolver::SQLResolver() { my_init(); }
+void SQLResolver::reset_stats() {
+    for (const auto& it : *connections.load(std::memory_order_acquire)) {
+        it.second->stats.reset();
+    }
+}
 
-SQLResolver::~SQLResolver() { clear(); }
+bool SQLResolver::dump_stats(const std::string& path) {
+    auto* file = fopen(path.c_str(), "a");
+    if (file == nullptr) {
+        SQL_WARN(
+            "[SQLResolver] Failed opening %s to write statistics.",
+            path.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    const auto pid = 0;
+#else
+    const auto pid = static_cast<int>(getpid());
+#endif
+    fprintf(
+        file, "# usd sql resolver statistics, pid %i, time %lld\n", pid,
+        static_cast<long long>(time(nullptr)));
+    for (const auto& server : get_stats()) {
+        for (const auto& counter : server.counters) {
+            fprintf(
+                file, "%s %s %llu\n", server.server.c_str(),
+                counter.first.c_str(),
+                static_cast<unsigned long long>(counter.second));
+        }
+        for (const auto& latency : server.latencies) {
+            if (latency.count == 0) { continue; }
+            fprintf(
+                file,
+                "%s %s count %llu mean_us %.1f p50_us %.1f p99_us %.1f "
+                "max_us %.1f\n",
+                server.server.c_str(), latency.name.c_str(),
+                static_cast<unsigned long long>(latency.count),
+                latency.mean / 1e3, static_cast<double>(latency.p50) / 1e3,
+                static_cast<double>(latency.p99) / 1e3,
+                static_cast<double>(latency.max) / 1e3);
+        }
+    }
+    const auto ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
 
 void SQLResolver::clear() {}
 
 SQLConnection* SQLResolver::get_connection(bool create) {
-    sql_thread_init();
-    SQLConnection* conn = nullptr;
-    {
-        const auto server_name = getenv(HOST_ENV_VAR);
-        if (server_name == nullptr) {
-            SQL_WARN(
-                "[SQLResolver] Could not get host name - make sure $%s"
-                " is defined",
-                HOST_ENV_VAR);
-            return conn;
-        }
-        mutex_scoped_lock sc(connections_mutex);
-        conn = find_in_sorted_vector<
-            connection_pair::first_type, connection_pair::second_type, nullptr>(
-            connections, server_name);
-        if (create && conn == nullptr) { // initialize new connection
-            conn = new SQLConnection(server_name);
-            connections.emplace_back(server_name, conn);
-            std::sort(
-                connections.begin(), connections.end(),
-                [](const connection_pair& a, const connection_pair& b) -> bool {
-                    return a.first < b.first;
-                });
-        }
+    const auto server_name = getenv(HOST_ENV_VAR);
+    if (server_name == nullptr) {
+        SQL_WARN(
+            "[SQLResolver] Could not get host name - make sure $%s"
+            " is defined",
+            HOST_ENV_VAR);
+        return nullptr;
+    }
+    auto* conn = find_in_sorted_vector<
+        const char*, connection_pair::second_type, nullptr, connection_pair>(
+        *connections.load(std::memory_order_acquire), server_name);
+    if (!create || conn != nullptr) { return conn; }
+
+    mutex_scoped_lock sc(connections_mutex);
+    // Another thread might have added the server while we were waiting.
+    const auto* current = connections.load(std::memory_order_acquire);
+    conn = find_in_sorted_vector<
+        const char*, connection_pair::second_type, nullptr, connection_pair>(
+        *current, server_name);
+    if (conn == nullptr) { // initialize new connection
+        conn = new SQLConnection(server_name);
+        std::unique_ptr<connection_snapshot> snapshot(
+            new connection_snapshot(*current));
+        snapshot->emplace_back(server_name, conn);
+        std::sort(
+            snapshot->begin(), snapshot->end(),
+            [](const connection_pair& a, const connection_pair& b) -> bool {
+                return a.first < b.first;
+            });
+        connections.store(snapshot.get(), std::memory_order_release);
+        snapshots.emplace_back(std::move(snapshot));
     }
     return conn;
 }
@@ -312,69 +345,214 @@ std::shared_ptr<ArAsset> SQLResolver::open_asset(const std::string& path) {
     return conn == nullptr ? nullptr : conn->open_asset(clean_path(path));
 }
 
-SQLConnection::SQLConnection(const std::string& server_name)
-    : connection(mysql_init(nullptr)) {
-    const auto server_user = get_env_var(server_name, USER_ENV_VAR, "root");
-    const auto compacted_default_pass =
-        z85::encode_with_padding(std::string("12345678"));
-    auto server_password =
-        get_env_var(server_name, PASSWORD_ENV_VAR, compacted_default_pass);
-    server_password = z85::decode_with_padding(server_password);
-    const auto server_db = get_env_var(server_name, DB_ENV_VAR, "usd");
-    table_name = get_env_var(server_name, TABLE_ENV_VAR, "headers");
-    const auto server_port = static_cast<unsigned int>(
-        atoi(get_env_var(server_name, PORT_ENV_VAR, "3306").c_str()));
-    // Turn on auto-reconnect
-    // Note that it IS still possible for the reconnect to fail, and we
-    // don't do any explicit check for this; experimented with also adding
-    // a check with mysql_ping in get_connection after retrieving
-    // a cached result, but decided against this approach, as it added
-    // a lot of extra spam if something DID go wrong (because a lot of
-    // resolve name calls will still "work" by just using the cached
-    // result
-    // Also, it's good practice to add error checking after every usage
-    // of mysql anyway (can fail in more ways than just connection being
-    // lost), so these will catch / print error when reconnection fails
-    // as well
-    my_bool reconnect = 1;
-    mysql_options(connection, MYSQL_OPT_RECONNECT, &reconnect);
-    const auto ret = mysql_real_connect(
-        connection, server_name.c_str(), server_user.c_str(),
-        server_password.c_str(), server_db.c_str(), server_port, nullptr, 0);
-    if (ret == nullptr) {
-        mysql_close(connection);
+std::vector<std::string> SQLResolver::find_assets(
+    const std::vector<std::string>& paths) {
+    std::vector<std::string> ret(paths.size());
+    auto conn = get_connection(true);
+    if (conn == nullptr) { return ret; }
+    std::vector<std::string> cleaned_paths;
+    cleaned_paths.reserve(paths.size());
+    for (const auto& path : paths) { cleaned_paths.push_back(clean_path(path)); }
+    const auto found = conn->find_assets(cleaned_paths);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (found[i]) { ret[i] = std::move(cleaned_paths[i]); }
+    }
+    return ret;
+}
+
+std::vector<std::shared_ptr<ArAsset>> SQLResolver::open_assets(
+    const std::vector<std::string>& paths) {
+    auto conn = get_connection(false);
+    if (conn == nullptr) {
+        return std::vector<std::shared_ptr<ArAsset>>(paths.size());
+    }
+    std::vector<std::string> cleaned_paths;
+    cleaned_paths.reserve(paths.size());
+    for (const auto& path : paths) { cleaned_paths.push_back(clean_path(path)); }
+    return conn->open_assets(cleaned_paths);
+}
+
+std::future<std::string> SQLResolver::find_asset_async(
+    const std::string& path) {
+    auto conn = get_connection(true);
+    if (conn == nullptr) { return make_ready_future(std::string()); }
+    auto cleaned_path = clean_path(path);
+    return conn->executor.submit([conn, cleaned_path]() -> std::string {
+        return conn->find_asset(cleaned_path) ? cleaned_path : "";
+    });
+}
+
+std::future<std::shared_ptr<ArAsset>> SQLResolver::open_asset_async(
+    const std::string& path) {
+    auto conn = get_connection(false);
+    if (conn == nullptr) {
+        return make_ready_future(std::shared_ptr<ArAsset>());
+    }
+    auto cleaned_path = clean_path(path);
+    return conn->executor.submit([conn, cleaned_path]() {
+        return conn->open_asset(cleaned_path);
+    });
+}
+
+namespace {
+
+size_t get_memory_budget(const std::string& server_name) {
+    const auto budget = get_env_var(server_name, MEMORY_BUDGET_ENV_VAR, "");
+    if (budget.empty()) { return std::numeric_limits<size_t>::max(); }
+    return static_cast<size_t>(std::max(0ll, atoll(budget.c_str())))
+           << 20;
+}
+
+std::unique_ptr<DiskCache> make_disk_cache(const std::string& server_name) {
+    const auto root = get_env_var(server_name, CACHE_PATH_ENV_VAR, "");
+    if (root.empty()) { return nullptr; }
+    return std::unique_ptr<DiskCache>(new DiskCache(root, server_name));
+}
+
+std::unique_ptr<Backend> make_backend(
+    const std::string& server_name, const std::string& table_name,
+    const std::string& hash_column) {
+    const auto kind = get_env_var(server_name, BACKEND_ENV_VAR, "mysql");
+    if (kind == "sqlite") {
+        return make_sqlite_backend(server_name, table_name, hash_column);
+    }
+    if (kind != "mysql") {
         SQL_WARN(
-            "[SQLResolver] Failed to connect to: %s\nReason: %s",
-            server_name.c_str(), mysql_error(connection));
-        connection = nullptr;
-    }
-#if SESSION_WAIT_TIMEOUT > 0
-    else {
-        const auto query_ret = mysql_real_query(
-            connection, SET_SESSION_WAIT_TIMEOUT_QUERY,
-            SET_SESSION_WAIT_TIMEOUT_QUERY_STRLEN);
-        if (query_ret != 0) {
-            SQL_WARN(
-                "[SQLResolver] Error executing query: %s\nError code: "
-                "%i\nError string: %s",
-                SET_SESSION_WAIT_TIMEOUT_QUERY, mysql_errno(connection),
-                mysql_error(connection));
+            "[SQLResolver] Unknown backend %s for %s, using mysql.",
+            kind.c_str(), server_name.c_str());
+    }
+    return make_mysql_backend(server_name, table_name, hash_column);
+}
+
+} // namespace
+
+SQLConnection::SQLConnection(const std::string& server_name)
+    : SQLConnection(
+          server_name,
+          make_backend(
+              server_name,
+              get_env_var(server_name, TABLE_ENV_VAR, "headers"),
+              get_env_var(server_name, HASH_COLUMN_ENV_VAR, ""))) {}
+
+SQLConnection::SQLConnection(
+    const std::string& server_name, std::unique_ptr<Backend> storage)
+    : lru(get_memory_budget(server_name)),
+      table_name(get_env_var(server_name, TABLE_ENV_VAR, "headers")),
+      hash_column(get_env_var(server_name, HASH_COLUMN_ENV_VAR, "")),
+      disk_cache(make_disk_cache(server_name)),
+      backend(std::move(storage)),
+      executor(backend->capacity()),
+      revalidate_window(std::chrono::milliseconds(std::max(
+          0, atoi(get_env_var(server_name, REVALIDATE_ENV_VAR, "0")
+                      .c_str())))),
+      negative_window(std::chrono::milliseconds(std::max(
+          0, atoi(get_env_var(server_name, NEGATIVE_TTL_ENV_VAR, "0")
+                      .c_str())))),
+      range_threshold(static_cast<size_t>(std::max(
+          0ll, atoll(get_env_var(server_name, RANGE_THRESHOLD_ENV_VAR, "0")
+                         .c_str())))),
+      prefetch(
+          atoi(get_env_var(server_name, PREFETCH_ENV_VAR, "0").c_str()) != 0),
+      poll_interval(std::chrono::milliseconds(std::max(
+          0, atoi(get_env_var(server_name, POLL_ENV_VAR, "0").c_str())))) {
+    if (backend->is_valid() && poll_interval.count() > 0) {
+        poll_thread = std::thread(&SQLConnection::poll_changes, this);
+    }
+}
+
+SQLConnection::~SQLConnection() {
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex);
+        poll_stop = true;
+    }
+    poll_cv.notify_all();
+    if (poll_thread.joinable()) { poll_thread.join(); }
+}
+
+Backend::Handle SQLConnection::acquire() {
+    TRACE_SCOPE("SQL session wait");
+    ServerStats::Timer timer(stats.waits[STAT_WAIT_SESSION]);
+    return backend->acquire();
+}
+
+void SQLConnection::poll_changes() {
+    double high_water = 0.0;
+    bool started = false;
+    std::unique_lock<std::mutex> lock(poll_mutex);
+    while (!poll_stop) {
+        lock.unlock();
+        // Changes committed after the query started are only seen by the next
+        // poll, so the results are only valid from this point.
+        const auto poll_start =
+            std::chrono::steady_clock::now().time_since_epoch().count();
+        bool polled = false;
+        // Newer timestamps are stored once the session is released, as that
+        // waits for running fetches, which may need a session themselves.
+        std::vector<std::pair<Cache*, double>> changed;
+        {
+            TRACE_SCOPE("SQL change polling");
+            auto session = acquire();
+            if (session && !started) {
+                ServerStats::Timer timer(stats.queries[STAT_QUERY_POLL]);
+                polled = session->latest_change(high_water);
+                started = polled;
+            } else if (session) {
+                ServerStats::Timer timer(stats.queries[STAT_QUERY_POLL]);
+                polled = session->changes(
+                    high_water,
+                    [&](const std::string& path, double stamp) {
+                        auto* cache = cached_queries.find(
+                            TfToken(SQL_PREFIX_SHORT + path));
+                        if (cache == nullptr) { return; }
+                        // The next resolve has to ask the server again.
+                        if (cache->state == CACHE_MISSING) {
+                            cache->missing_at = 0;
+                            return;
+                        }
+                        if (stamp <= cache->timestamp) { return; }
+                        TF_DEBUG(USD_URI_SQL_RESOLVER)
+                            .Msg(
+                                "SQLConnection::poll_changes: %s changed "
+                                "from %f to %f\n",
+                                path.c_str(), cache->timestamp.load(), stamp);
+                        changed.emplace_back(cache, stamp);
+                    });
+            }
+        }
+        for (const auto& change : changed) {
+            set_newer_timestamp(*change.first, change.second);
         }
+        if (polled) { last_poll = poll_start; }
+        lock.lock();
+        poll_cv.wait_for(lock, poll_interval, [this]() { return poll_stop; });
     }
-#endif // SESSION_WAIT_TIMEOUT
+}
+
+bool SQLConnection::is_polling() const {
+    if (poll_interval.count() <= 0) { return false; }
+    // Allow the poller to be one interval late before we stop relying on it.
+    return Cache::now() - last_poll.load() < 2 * poll_interval.count();
+}
+
+bool SQLConnection::is_up_to_date(const Cache& cache) const {
+    return cache.validated_within(revalidate_window) || is_polling();
+}
+
+bool SQLConnection::is_fresh(const Cache& cache) const {
+    return cache.timestamp_fresh &&
+           cache.validated_within(FRESH_TIMESTAMP_WINDOW);
+}
+
+bool SQLConnection::is_known_missing(const Cache& cache) const {
+    // The poller clears the entry early when the asset shows up, but rows
+    // written with an older timestamp are missed, so the window still holds.
+    return cache.missing_within(negative_window);
 }
 
 bool SQLConnection::find_asset(const std::string& asset_path) {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_SQL_RESOLVER)
         .Msg("SQLConnection::find_asset: '%s'\n", asset_path.c_str());
-    if (connection == nullptr) {
-        TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg(
-                "SQLConnection::find_asset: aborting due to null "
-                "connection pointer\n");
-        return false;
-    }
-
     const auto last_dot = asset_path.find_last_of('.');
     if (last_dot == std::string::npos) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
@@ -384,102 +562,136 @@ bool SQLConnection::find_asset(const std::string& asset_path) {
                 asset_path.c_str());
         return false;
     }
-    mutex_scoped_lock sc(connection_mutex);
 
     const TfToken asset_path_token(asset_path);
-    auto cached_result = cached_queries.find(asset_path_token);
-
-    auto fill_cache_data = [&](Cache& cache) -> bool {
-        const TfToken parsed_path(parse_path(asset_path));
-        constexpr size_t query_max_length = 4096;
-        char query[query_max_length];
-        snprintf(
-            query, query_max_length,
-            "SELECT EXISTS(SELECT 1 FROM %s WHERE path = '%s')",
-            table_name.c_str(), parsed_path.GetText());
-        auto query_length = strlen(query);
+    auto* cache = cached_queries.find(asset_path_token);
+    if (cache != nullptr && cache->state != CACHE_MISSING) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg("SQLConnection::find_asset: query:\n%s\n", query);
-        const auto query_ret =
-            mysql_real_query(connection, query, query_length);
-        // I only have to flush when there is a successful query.
-        MySQLResult result;
-        if (query_ret != 0) {
-            SQL_WARN(
-                "[SQLResolver] Error executing query: %s\nError code: "
-                "%i\nError string: %s",
-                query, mysql_errno(connection), mysql_error(connection));
-            return false;
-        } else {
-            result.reset(mysql_store_result(connection));
-        }
-
-        if (result == nullptr) { return false; }
+            .Msg(
+                "SQLConnection::find_asset: using cached result: "
+                "'%s'\n",
+                cache->local_path.GetText());
+        stats.add(STAT_RESOLVE_HIT);
+        return !cache->local_path.IsEmpty();
+    }
 
-        assert(mysql_num_rows(result.get()) == 1);
-        auto row = mysql_fetch_row(result.get());
-        assert(mysql_num_fields(result.get()) == 1);
+    if (cache != nullptr && is_known_missing(*cache)) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLConnection::find_asset: using cached missing result: "
+                "'%s'\n",
+                asset_path.c_str());
+        stats.add(STAT_RESOLVE_MISSING_HIT);
+        return false;
+    }
 
-        if (row[0] == nullptr || strcmp(row[0], "1") != 0) { return false; }
+    // Entries are only created with a valid backend, so hits don't check it.
+    if (!backend->is_valid()) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg("SQLConnection::find_asset: found: %s\n", asset_path.c_str());
-        cache.local_path = parsed_path;
-        cache.state = CACHE_NEEDS_FETCHING;
-        cache.timestamp = 1.0;
+            .Msg(
+                "SQLConnection::find_asset: aborting due to null "
+                "connection pointer\n");
+        return false;
+    }
+
+    if (cache == nullptr) {
+        cache = cached_queries.insert(
+            asset_path_token, TfToken(parse_path(asset_path)));
+    }
+    stats.add(STAT_RESOLVE_MISS);
+    auto result = RESOLVE_FAILED;
+    auto timestamp = INVALID_TIME;
+    size_t size = 0;
+    {
+        auto session = acquire();
+        if (!session) { return false; }
+        ServerStats::Timer timer(stats.queries[STAT_QUERY_RESOLVE]);
+        result = session->resolve(cache->local_path, timestamp, size);
+    }
+    if (result == RESOLVE_MISSING) {
+        cache->mark_missing();
+        return false;
+    } else if (result == RESOLVE_FAILED) {
+        return false;
+    }
+
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "SQLConnection::find_asset: found: %s, timestamp: %f, size: %zu\n",
+            asset_path.c_str(), timestamp, size);
+    // Another thread might have resolved and fetched the asset meanwhile.
+    if (cache->set_resolved(timestamp, size)) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
             .Msg(
                 "SQLConnection::find_asset: local path: %s\n",
-                cache.local_path.GetText());
-        return true;
-    };
-
-    if (cached_result != cached_queries.end()) {
-        if (cached_result->second.state != CACHE_MISSING) {
-            TF_DEBUG(USD_URI_SQL_RESOLVER)
-                .Msg(
-                    "SQLConnection::find_asset: using cached result: "
-                    "'%s'\n",
-                    cached_result->second.local_path.GetText());
-            return !cached_result->second.local_path.IsEmpty();
-        }
-        return fill_cache_data(cached_result->second);
-    } else {
-        Cache cache{CACHE_MISSING, TfToken()};
-        const auto result = fill_cache_data(cache);
-        cached_queries.emplace(asset_path_token, cache);
-        return result;
+                cache->local_path.GetText());
     }
+    return true;
 }
 
 double SQLConnection::get_timestamp(const std::string& asset_path) {
-    if (connection == nullptr) { return 1.0; }
-
-    mutex_scoped_lock sc(connection_mutex);
-    const auto cached_result = cached_queries.find(TfToken(asset_path));
-    if (cached_result == cached_queries.end() ||
-        cached_result->second.state == CACHE_MISSING) {
+    TRACE_FUNCTION();
+    auto* cache = cached_queries.find(TfToken(asset_path));
+    if (cache == nullptr || cache->state == CACHE_MISSING) {
+        if (!backend->is_valid()) { return 1.0; }
+        stats.add(STAT_TIMESTAMP_UNRESOLVED);
         SQL_WARN(
             "[SQLResolver] %s is missing when querying timestamps!",
             asset_path.c_str());
         return 1.0;
     }
-    const auto stamp = get_timestamp_raw(
-        connection, table_name, cached_result->second.local_path);
+
+    // The resolve just read the timestamp, no need to ask again.
+    if (cache->timestamp_fresh.exchange(false) &&
+        cache->validated_within(FRESH_TIMESTAMP_WINDOW)) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLConnection::get_timestamp: using timestamp from resolve "
+                "for %s\n",
+                asset_path.c_str());
+        stats.add(STAT_TIMESTAMP_FRESH_HIT);
+        return cache->timestamp;
+    }
+
+    if (is_up_to_date(*cache)) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLConnection::get_timestamp: using recently validated "
+                "timestamp for %s\n",
+                asset_path.c_str());
+        stats.add(STAT_TIMESTAMP_HIT);
+        return cache->timestamp;
+    }
+
+    stats.add(STAT_TIMESTAMP_MISS);
+    auto stamp = INVALID_TIME;
+    {
+        auto session = acquire();
+        if (session) {
+            ServerStats::Timer timer(stats.queries[STAT_QUERY_TIMESTAMP]);
+            stamp = session->get_timestamp(cache->local_path);
+        }
+    }
+
+    const double cached_stamp = cache->timestamp;
     if (stamp == INVALID_TIME) {
-        cached_result->second.state = CACHE_MISSING;
+        cache->state = CACHE_MISSING;
         SQL_WARN(
             "[SQLResolver] Failed to parse timestamp for %s, returning the"
             "existing value.",
             asset_path.c_str());
-        return cached_result->second.timestamp;
-    } else if (stamp > cached_result->second.timestamp) {
+        return cached_stamp;
+    } else if (stamp > cached_stamp) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
             .Msg(
                 "SQLConnection::get_timestamp: %s timestamp has changed from "
                 "%f to %f\n",
-                asset_path.c_str(), cached_result->second.timestamp, stamp);
-        cached_result->second.state = CACHE_NEEDS_FETCHING;
+                asset_path.c_str(), cached_stamp, stamp);
+        // Keep the new timestamp, so it can be handed out while still valid.
+        set_newer_timestamp(*cache, stamp);
     }
+    // Any data left in the entry is at least as new as stamp by now.
+    cache->mark_validated();
     TF_DEBUG(USD_URI_SQL_RESOLVER)
         .Msg(
             "SQLConnection::get_timestamp: timestamp of %f for %s", stamp,
@@ -487,44 +699,264 @@ double SQLConnection::get_timestamp(const std::string& asset_path) {
     return stamp;
 }
 
+bool SQLConnection::is_ranged(const Cache& cache) const {
+    return range_threshold > 0 && cache.size >= range_threshold;
+}
+
+SQLServerStats SQLConnection::get_stats() const {
+    SQLServerStats ret;
+    for (size_t i = 0; i < STAT_COUNTER_COUNT; ++i) {
+        ret.counters.emplace_back(
+            STAT_COUNTER_NAMES[i], stats.get(static_cast<StatCounter>(i)));
+    }
+    ret.counters.emplace_back("sessions_opened", backend->sessions_opened());
+    ret.counters.emplace_back("reconnects", backend->reconnects());
+    const auto add_latency = [&ret](const char* name, const Histogram& h) {
+        ret.latencies.push_back(
+            {name, h.count(), h.mean(), h.percentile(0.5), h.percentile(0.99),
+             h.max()});
+    };
+    for (size_t i = 0; i < STAT_QUERY_COUNT; ++i) {
+        add_latency(STAT_QUERY_NAMES[i], stats.queries[i]);
+    }
+    for (size_t i = 0; i < STAT_WAIT_COUNT; ++i) {
+        add_latency(STAT_WAIT_NAMES[i], stats.waits[i]);
+    }
+    return ret;
+}
+
+std::shared_ptr<ArAsset> SQLConnection::fetch(
+    Backend::Session& session, const TfToken& local_path, double& timestamp) {
+    TRACE_FUNCTION();
+    auto asset = stats.query(STAT_QUERY_FETCH, [&]() {
+        return session.fetch(local_path, timestamp);
+    });
+    if (asset != nullptr) {
+        stats.add(STAT_OPEN_FETCHED);
+        stats.add(STAT_BYTES_FETCHED, asset->GetSize());
+        TRACE_COUNTER_DELTA("SQL bytes fetched", asset->GetSize());
+    }
+    return asset;
+}
+
+std::shared_ptr<ArAsset> SQLConnection::open_ranged(
+    const TfToken& local_path, double timestamp, size_t size,
+    std::shared_ptr<char> first_block) {
+    // Connections are never destroyed, so the asset can outlive the resolver.
+    return std::make_shared<RangeAsset>(
+        size, [this, local_path, timestamp](
+                  size_t offset, size_t count, char* buffer) -> bool {
+            TRACE_SCOPE("SQL ranged read");
+            auto session = acquire();
+            if (!session) { return false; }
+            ServerStats::Timer timer(stats.queries[STAT_QUERY_RANGE]);
+            if (!session->fetch_range(
+                    local_path, timestamp, offset, count, buffer)) {
+                return false;
+            }
+            stats.add(STAT_BYTES_RANGED, count);
+            TRACE_COUNTER_DELTA("SQL bytes ranged", count);
+            return true;
+        },
+        std::move(first_block));
+}
+
+void SQLConnection::touch(const std::shared_ptr<ArAsset>& asset) {
+    if (dynamic_cast<const RangeAsset*>(asset.get()) != nullptr) { return; }
+    lru.touch(asset);
+}
+
+void SQLConnection::set_fetched(
+    Cache& cache, const std::shared_ptr<ArAsset>& asset, double timestamp) {
+    cache.asset = asset;
+    touch(asset);
+    cache.timestamp = timestamp;
+    cache.size = asset->GetSize();
+    cache.size_timestamp = timestamp;
+    cache.timestamp_fresh = false;
+    cache.mark_validated();
+    cache.state = CACHE_FETCHED;
+}
+
+std::shared_ptr<ArAsset> SQLConnection::load_from_disk(
+    Cache& cache, double timestamp) {
+    if (disk_cache == nullptr || timestamp == INVALID_TIME) { return nullptr; }
+    auto asset = disk_cache->load(cache.local_path, timestamp);
+    if (asset == nullptr) { return nullptr; }
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLConnection::open_asset: using data from disk\n");
+    stats.add(STAT_OPEN_DISK_HIT);
+    stats.add(STAT_BYTES_FROM_DISK, asset->GetSize());
+    TRACE_COUNTER_DELTA("SQL bytes from disk", asset->GetSize());
+    set_fetched(cache, asset, timestamp);
+    prefetch_references(asset);
+    return asset;
+}
+
+void SQLConnection::set_newer_timestamp(Cache& cache, double timestamp) {
+    std::lock_guard<std::mutex> lock(cache.fetch_mutex);
+    if (cache.state == CACHE_MISSING || timestamp <= cache.timestamp) {
+        return;
+    }
+    cache.transition(CACHE_FETCHED, CACHE_NEEDS_FETCHING);
+    cache.timestamp = timestamp;
+}
+
+void SQLConnection::store_on_disk(
+    const TfToken& local_path, const std::shared_ptr<ArAsset>& asset,
+    double timestamp) {
+    if (disk_cache == nullptr || timestamp == INVALID_TIME) { return; }
+    executor.submit([this, local_path, asset, timestamp]() {
+        const auto buffer = asset->GetBuffer();
+        disk_cache->store(
+            local_path, timestamp, buffer.get(), asset->GetSize());
+    });
+}
+
+void SQLConnection::prefetch_references(
+    const std::shared_ptr<ArAsset>& asset) {
+    if (!prefetch) { return; }
+    const auto buffer = asset->GetBuffer();
+    if (buffer == nullptr) { return; }
+    auto paths = scan_sql_paths(buffer.get(), asset->GetSize());
+    // Known paths are either fetched already, or being fetched.
+    paths.erase(
+        std::remove_if(
+            paths.begin(), paths.end(),
+            [this](const std::string& path) {
+                return cached_queries.find(TfToken(path)) != nullptr;
+            }),
+        paths.end());
+    if (paths.empty()) { return; }
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg(
+            "SQLConnection::prefetch_references: prefetching %zu paths\n",
+            paths.size());
+    executor.submit([this, paths]() {
+        const auto found = find_assets(paths);
+        std::vector<std::string> to_open;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (found[i]) { to_open.push_back(paths[i]); }
+        }
+        if (!to_open.empty()) { open_assets(to_open); }
+    });
+}
+
 std::shared_ptr<ArAsset> SQLConnection::open_asset(
     const std::string& asset_path) {
+    TRACE_FUNCTION();
     TF_DEBUG(USD_URI_SQL_RESOLVER)
         .Msg("SQLConnection::open_asset: '%s'\n", asset_path.c_str());
-    if (connection == nullptr) {
-        TF_DEBUG(USD_URI_SQL_RESOLVER)
-            .Msg(
-                "SQLConnection::open_asset: aborting due to null connection "
-                "pointer\n");
-        return nullptr;
-    }
-
-    mutex_scoped_lock sc(connection_mutex);
-    const auto cached_result = cached_queries.find(TfToken(asset_path));
-    if (cached_result == cached_queries.end()) {
+    auto* cache = cached_queries.find(TfToken(asset_path));
+    if (cache == nullptr) {
+        if (!backend->is_valid()) {
+            TF_DEBUG(USD_URI_SQL_RESOLVER)
+                .Msg(
+                    "SQLConnection::open_asset: aborting due to null "
+                    "connection pointer\n");
+            return nullptr;
+        }
         SQL_WARN(
             "[SQLResolver] %s was not resolved before fetching!",
             asset_path.c_str());
         return nullptr;
     }
 
-    if (cached_result->second.state == CACHE_MISSING) {
+    // Only one thread fetches a given asset, the others wait for the result.
+    std::unique_lock<std::mutex> fetch_lock(
+        cache->fetch_mutex, std::defer_lock);
+    {
+        TRACE_SCOPE("SQL fetch wait");
+        ServerStats::Timer timer(stats.waits[STAT_WAIT_FETCH]);
+        fetch_lock.lock();
+    }
+    if (cache->state == CACHE_MISSING) {
         TF_DEBUG(USD_URI_SQL_RESOLVER)
             .Msg(
                 "SQLConnection::open_asset: missing from database, no fetch\n");
+        stats.add(STAT_OPEN_FAILED);
         return nullptr;
     }
 
-    if (cached_result->second.state == CACHE_FETCHED) {
+    auto cached = cache->asset.lock();
+    // The data was evicted, only the metadata is left.
+    if (cached == nullptr &&
+        cache->transition(CACHE_FETCHED, CACHE_NEEDS_FETCHING)) {
+        stats.add(STAT_OPEN_EVICTED);
+    }
+
+    if (cache->state == CACHE_FETCHED &&
+        is_up_to_date(*cache)) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLConnection::open_asset: using recently validated "
+                "data\n");
+        stats.add(STAT_OPEN_HIT);
+        touch(cached);
+        return cached;
+    }
+
+    // The data on disk only needs a timestamp check. If the cached timestamp
+    // can be trusted, no session is needed.
+    const bool trusted_timestamp =
+        cache->state == CACHE_NEEDS_FETCHING &&
+        (is_fresh(*cache) || is_up_to_date(*cache));
+    if (trusted_timestamp) {
+        auto asset = load_from_disk(*cache, cache->timestamp);
+        if (asset != nullptr) { return asset; }
+    }
+
+    auto session = acquire();
+    if (!session) { return nullptr; }
+
+    // Checks the timestamp and downloads newer data in a single round trip.
+    // Shared and ranged data need the timestamp before deciding what to
+    // download. If the backend can't compare the timestamp, we fall back to
+    // checking it first.
+    if (cache->state == CACHE_FETCHED && hash_column.empty() &&
+        !is_ranged(*cache)) {
+        std::shared_ptr<ArAsset> asset;
+        double timestamp = INVALID_TIME;
+        const auto result = stats.query(STAT_QUERY_FETCH_IF_NEWER, [&]() {
+            return session->fetch_if_newer(
+                cache->local_path, cache->timestamp, asset, timestamp);
+        });
+        if (result == RESOLVE_FOUND) {
+            TF_DEBUG(USD_URI_SQL_RESOLVER)
+                .Msg(
+                    "SQLConnection::open_asset: local path data was out of "
+                    "date.\n");
+            stats.add(STAT_OPEN_FETCHED);
+            stats.add(STAT_BYTES_FETCHED, asset->GetSize());
+            TRACE_COUNTER_DELTA("SQL bytes fetched", asset->GetSize());
+            store_on_disk(cache->local_path, asset, timestamp);
+            set_fetched(*cache, asset, timestamp);
+            prefetch_references(asset);
+            return asset;
+        }
+        if (result == RESOLVE_MISSING) {
+            cache->mark_validated();
+            stats.add(STAT_OPEN_NOT_MODIFIED);
+            touch(cached);
+            return cached;
+        }
+    }
+
+    auto current_timestamp = INVALID_TIME;
+    if (cache->state == CACHE_FETCHED) {
         // Ensure cached state is up to date before deciding not to fetch
         // (there is no guarantee that get_timestamp was called prior to
         // fetch)
-        auto current_timestamp = get_timestamp_raw(
-            connection, table_name, cached_result->second.local_path);
+        current_timestamp = stats.query(STAT_QUERY_TIMESTAMP, [&]() {
+            return session->get_timestamp(cache->local_path);
+        });
         // So we can fail faster next time.
         if (current_timestamp == INVALID_TIME ||
-            current_timestamp <= cached_result->second.timestamp) {
-            return cached_result->second.asset;
+            current_timestamp <= cache->timestamp) {
+            if (current_timestamp != INVALID_TIME) { cache->mark_validated(); }
+            stats.add(STAT_OPEN_NOT_MODIFIED);
+            touch(cached);
+            return cached;
         } else {
             TF_DEBUG(USD_URI_SQL_RESOLVER)
                 .Msg(
@@ -535,57 +967,267 @@ std::shared_ptr<ArAsset> SQLConnection::open_asset(
 
     TF_DEBUG(USD_URI_SQL_RESOLVER)
         .Msg("SQLConnection::fetch: Cache needed fetching\n");
-    cached_result->second.state =
-        CACHE_MISSING; // we'll set this up if fetching is successful
-
-    MySQLResult result;
-    constexpr size_t query_max_length = 4096;
-    char query[query_max_length];
-    snprintf(
-        query, query_max_length,
-        "SELECT data, timestamp FROM %s WHERE path = '%s' LIMIT 1",
-        table_name.c_str(), cached_result->second.local_path.GetText());
-    unsigned long query_length = strlen(query);
-    TF_DEBUG(USD_URI_SQL_RESOLVER)
-        .Msg("SQLConnection::open_asset: query:\n%s\n", query);
-    const auto query_ret = mysql_real_query(connection, query, query_length);
-    // I only have to flush when there is a successful query.
-    if (query_ret != 0) {
-        SQL_WARN(
-            "[SQLResolver] Error executing query: %s\nError code: "
-            "%i\nError string: %s",
-            query, mysql_errno(connection), mysql_error(connection));
+    if (disk_cache != nullptr && !trusted_timestamp) {
+        if (current_timestamp == INVALID_TIME) {
+            current_timestamp = stats.query(STAT_QUERY_TIMESTAMP, [&]() {
+                return session->get_timestamp(cache->local_path);
+            });
+        }
+        auto asset = load_from_disk(*cache, current_timestamp);
+        if (asset != nullptr) { return asset; }
+    }
+    double timestamp = INVALID_TIME;
+    std::shared_ptr<ArAsset> asset;
+    std::string hash;
+    double hash_timestamp = INVALID_TIME;
+    if (!hash_column.empty() &&
+        stats.query(STAT_QUERY_HASH, [&]() {
+            return session->hash(cache->local_path, hash, hash_timestamp);
+        })) {
+        asset = hash_index.find(hash);
+        if (asset != nullptr) {
+            TF_DEBUG(USD_URI_SQL_RESOLVER)
+                .Msg(
+                    "SQLConnection::open_asset: sharing data with the same "
+                    "hash\n");
+            stats.add(STAT_OPEN_HASH_HIT);
+            timestamp = hash_timestamp;
+            set_fetched(*cache, asset, timestamp);
+            return asset;
+        }
+    }
+    // Scanning ranged assets for references would download all of them.
+    bool ranged = false;
+    if (is_ranged(*cache)) {
+        // Only read the current version, the data follows as it is read.
+        // A trusted entry already knows the version and its size.
+        size_t size = cache->size;
+        const bool known = trusted_timestamp &&
+                           cache->size_timestamp == cache->timestamp;
+        if (known) { timestamp = cache->timestamp; }
+        if (known ||
+            stats.query(STAT_QUERY_RESOLVE, [&]() {
+                return session->resolve(cache->local_path, timestamp, size);
+            }) == RESOLVE_FOUND) {
+            // Compressed data has to be downloaded as a whole. The first
+            // block holds the header, and is kept for the reads that follow.
+            const auto block_size = std::min(RANGE_BLOCK_SIZE, size);
+            std::shared_ptr<char> block(
+                new char[block_size], std::default_delete<char[]>());
+            const auto read = stats.query(STAT_QUERY_RANGE, [&]() {
+                return session->fetch_range(
+                    cache->local_path, timestamp, 0, block_size, block.get());
+            });
+            if (read && is_compressed(block.get(), block_size)) {
+                asset = fetch(*session, cache->local_path, timestamp);
+                if (asset != nullptr) {
+                    store_on_disk(cache->local_path, asset, timestamp);
+                }
+            } else if (read) {
+                stats.add(STAT_OPEN_RANGED);
+                stats.add(STAT_BYTES_RANGED, block_size);
+                TRACE_COUNTER_DELTA("SQL bytes ranged", block_size);
+                asset = open_ranged(
+                    cache->local_path, timestamp, size, std::move(block));
+                ranged = true;
+            }
+        }
     } else {
-        result.reset(mysql_store_result(connection));
+        asset = fetch(*session, cache->local_path, timestamp);
+        if (asset != nullptr) {
+            store_on_disk(cache->local_path, asset, timestamp);
+        }
+        // The hash is only valid if the data did not change in between.
+        if (asset != nullptr && !hash.empty() && timestamp == hash_timestamp) {
+            hash_index.insert(hash, asset);
+        }
     }
+    if (asset == nullptr) {
+        // We'll set this up again if a later fetch is successful.
+        cache->state = CACHE_MISSING;
+        stats.add(STAT_OPEN_FAILED);
+        return nullptr;
+    }
+    set_fetched(*cache, asset, timestamp);
+    if (!ranged) { prefetch_references(asset); }
+    return asset;
+}
 
-    if (result == nullptr) { return nullptr; }
-
-    if (mysql_num_rows(result.get()) != 1) { return nullptr; }
-
-    auto row = mysql_fetch_row(result.get());
-    assert(mysql_num_fields(result.get()) == 2);
-    auto field = mysql_fetch_field(result.get());
-    if (row[0] == nullptr && field->max_length == 0) { return nullptr; }
+std::vector<bool> SQLConnection::find_assets(
+    const std::vector<std::string>& asset_paths) {
+    TRACE_FUNCTION();
+    std::vector<bool> found(asset_paths.size(), false);
+    if (!backend->is_valid()) { return found; }
+
+    // Local paths that need a query, and where to put the results.
+    std::unordered_map<
+        TfToken, std::pair<Cache*, std::vector<size_t>>, TfToken::HashFunctor>
+        pending;
+    std::vector<TfToken> to_query;
+    for (size_t i = 0; i < asset_paths.size(); ++i) {
+        const auto& asset_path = asset_paths[i];
+        if (asset_path.find_last_of('.') == std::string::npos) { continue; }
+        const TfToken asset_path_token(asset_path);
+        auto* cache = cached_queries.find(asset_path_token);
+        if (cache != nullptr && cache->state != CACHE_MISSING) {
+            found[i] = !cache->local_path.IsEmpty();
+            stats.add(STAT_RESOLVE_HIT);
+            continue;
+        }
+        if (cache != nullptr && is_known_missing(*cache)) {
+            stats.add(STAT_RESOLVE_MISSING_HIT);
+            continue;
+        }
+        if (cache == nullptr) {
+            cache = cached_queries.insert(
+                asset_path_token, TfToken(parse_path(asset_path)));
+        }
+        auto& entry = pending[cache->local_path];
+        if (entry.first == nullptr) {
+            entry.first = cache;
+            to_query.push_back(cache->local_path);
+        }
+        entry.second.push_back(i);
+    }
+    if (to_query.empty()) { return found; }
 
     TF_DEBUG(USD_URI_SQL_RESOLVER)
         .Msg(
-            "SQLConnection::open_asset: successfully fetched "
-            "data\n");
-    cached_result->second.asset.reset(
-        new MemoryAsset(row[0], field->max_length));
-    cached_result->second.state = CACHE_FETCHED;
-
-    field = mysql_fetch_field(result.get());
-    cached_result->second.timestamp =
-        convert_mysql_result_to_time(field, row, 1);
-    if (cached_result->second.timestamp == INVALID_TIME) {
+            "SQLConnection::find_assets: querying %zu of %zu paths\n",
+            to_query.size(), asset_paths.size());
+    stats.add(STAT_RESOLVE_MISS, to_query.size());
+    auto session = acquire();
+    if (!session) { return found; }
+    ServerStats::Timer timer(stats.queries[STAT_QUERY_RESOLVE_BATCH]);
+    session->resolve_batch(
+        to_query, [&](const std::string& path, ResolveResult result,
+                      double timestamp, size_t size) {
+            const auto it = pending.find(TfToken(path));
+            if (it == pending.end()) { return; }
+            if (result == RESOLVE_MISSING) {
+                it->second.first->mark_missing();
+                return;
+            }
+            it->second.first->set_resolved(timestamp, size);
+            for (const auto i : it->second.second) { found[i] = true; }
+        });
+    return found;
+}
+
+std::vector<std::shared_ptr<ArAsset>> SQLConnection::open_assets(
+    const std::vector<std::string>& asset_paths) {
+    TRACE_FUNCTION();
+    std::vector<std::shared_ptr<ArAsset>> ret(asset_paths.size());
+    if (!backend->is_valid()) { return ret; }
+
+    // Entries fetched by the batch, we hold their fetch mutex until the
+    // results are stored. Everything else, like entries being fetched by
+    // another thread, or already fetched entries that need a timestamp check,
+    // go through open_asset afterwards.
+    std::unordered_map<
+        TfToken, std::pair<Cache*, std::vector<size_t>>, TfToken::HashFunctor>
+        pending;
+    std::vector<TfToken> to_query;
+    std::vector<std::unique_lock<std::mutex>> fetch_locks;
+    std::vector<size_t> singles;
+    for (size_t i = 0; i < asset_paths.size(); ++i) {
+        auto* cache = cached_queries.find(TfToken(asset_paths[i]));
+        if (cache == nullptr) {
+            singles.push_back(i);
+            continue;
+        }
+        const auto it = pending.find(cache->local_path);
+        if (it != pending.end()) {
+            it->second.second.push_back(i);
+            continue;
+        }
+        std::unique_lock<std::mutex> fetch_lock(
+            cache->fetch_mutex, std::try_to_lock);
+        if (!fetch_lock.owns_lock() ||
+            cache->state != CACHE_NEEDS_FETCHING || is_ranged(*cache)) {
+            singles.push_back(i);
+            continue;
+        }
+        if (is_fresh(*cache) || is_up_to_date(*cache)) {
+            ret[i] = load_from_disk(*cache, cache->timestamp);
+            if (ret[i] != nullptr) { continue; }
+        }
+        fetch_locks.push_back(std::move(fetch_lock));
+        pending[cache->local_path] = {cache, {i}};
+        to_query.push_back(cache->local_path);
+    }
+
+    if (!to_query.empty()) {
+        auto session = acquire();
+        // Data already resident under another path is not downloaded again.
+        std::unordered_map<
+            TfToken, std::pair<std::string, double>, TfToken::HashFunctor>
+            hashes;
+        if (session && !hash_column.empty()) {
+            ServerStats::Timer timer(stats.queries[STAT_QUERY_HASH_BATCH]);
+            session->hash_batch(
+                to_query,
+                [&](const std::string& path, const std::string& hash,
+                    double stamp) {
+                    const auto it = pending.find(TfToken(path));
+                    if (it == pending.end()) { return; }
+                    auto asset = hash_index.find(hash);
+                    if (asset == nullptr) {
+                        hashes[it->first] = {hash, stamp};
+                        return;
+                    }
+                    stats.add(STAT_OPEN_HASH_HIT);
+                    set_fetched(*it->second.first, asset, stamp);
+                    for (const auto i : it->second.second) { ret[i] = asset; }
+                });
+            to_query.erase(
+                std::remove_if(
+                    to_query.begin(), to_query.end(),
+                    [&](const TfToken& path) {
+                        return ret[pending[path].second[0]] != nullptr;
+                    }),
+                to_query.end());
+        }
         TF_DEBUG(USD_URI_SQL_RESOLVER)
             .Msg(
-                "SQLConnection::open_asset: failed parsing "
-                "timestamp\n");
+                "SQLConnection::open_assets: fetching %zu of %zu paths\n",
+                to_query.size(), asset_paths.size());
+        if (session) {
+            ServerStats::Timer timer(stats.queries[STAT_QUERY_FETCH_BATCH]);
+            session->fetch_batch(
+                to_query, [&](const std::string& path,
+                              const std::shared_ptr<ArAsset>& asset,
+                              double timestamp) {
+                    const auto it = pending.find(TfToken(path));
+                    if (it == pending.end() || ret[it->second.second[0]]) {
+                        return;
+                    }
+                    stats.add(STAT_OPEN_FETCHED);
+                    stats.add(STAT_BYTES_FETCHED, asset->GetSize());
+                    TRACE_COUNTER_DELTA("SQL bytes fetched", asset->GetSize());
+                    set_fetched(*it->second.first, asset, timestamp);
+                    store_on_disk(it->first, asset, timestamp);
+                    const auto hash = hashes.find(it->first);
+                    if (hash != hashes.end() &&
+                        hash->second.second == timestamp) {
+                        hash_index.insert(hash->second.first, asset);
+                    }
+                    prefetch_references(asset);
+                    for (const auto i : it->second.second) { ret[i] = asset; }
+                });
+        }
+        // Whatever the server did not return is missing.
+        for (const auto& it : pending) {
+            if (!ret[it.second.second[0]]) {
+                it.second.first->state = CACHE_MISSING;
+                stats.add(STAT_OPEN_FAILED);
+            }
+        }
     }
-    return cached_result->second.asset;
+    fetch_locks.clear();
+
+    for (const auto i : singles) { ret[i] = open_asset(asset_paths[i]); }
+    return ret;
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -6,11 +6,36 @@
 
 #include <pxr/usd/ar/asset.h>
 
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+// Statistics of a single server, since it was first used or last reset. The
+// names are listed in stats.h.
+struct SQLServerStats {
+    // Latencies are in nanoseconds.
+    struct Latency {
+        std::string name;
+        uint64_t count;
+        double mean;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t max;
+    };
+
+    std::string server;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    std::vector<Latency> latencies;
+};
+
 struct SQLConnection;
 class SQLResolver {
 public:
@@ -23,11 +48,47 @@ public:
     double get_timestamp(const std::string& path);
     std::shared_ptr<ArAsset> open_asset(const std::string& path);
 
+    // Resolve or open many paths at once. Paths that need a query are sent to
+    // the server in batches, instead of one round trip per path. The results
+    // are in the same order as the paths, empty for missing assets.
+    std::vector<std::string> find_assets(const std::vector<std::string>& paths);
+    std::vector<std::shared_ptr<ArAsset>> open_assets(
+        const std::vector<std::string>& paths);
+
+    // Same as find_asset and open_asset, but the queries run on the
+    // connection's worker threads. Use these to issue many requests at once,
+    // and only wait for the results when needed.
+    std::future<std::string> find_asset_async(const std::string& path);
+    std::future<std::shared_ptr<ArAsset>> open_asset_async(
+        const std::string& path);
+
+    // Counters and latencies of every server used so far. Sessions opened
+    // and reconnects are counted since startup, and not reset.
+    std::vector<SQLServerStats> get_stats();
+    void reset_stats();
+    // Appends the statistics of every server to a text file, returns false
+    // if the file can't be written.
+    bool dump_stats(const std::string& path);
+
 private:
     using connection_pair = std::pair<std::string, SQLConnection*>;
+    // Sorted by server name and never modified once published, adding a
+    // server publishes a new copy. This way lookups don't need to lock.
+    using connection_snapshot = std::vector<connection_pair>;
     SQLConnection* get_connection(bool create);
+    // Only taken when adding a new server.
     std::mutex connections_mutex;
-    std::vector<connection_pair> connections;
+    std::atomic<const connection_snapshot*> connections;
+    // Owns every published snapshot, because readers might still be using
+    // older ones. There are only a handful of servers, so this stays small.
+    std::vector<std::unique_ptr<const connection_snapshot>> snapshots;
+    // From USD_SQL_STATS_PATH, the statistics are dumped there on exit, and
+    // on USD_SQL_STATS_SIGNAL if set.
+    std::string stats_path;
+    int stats_signal = 0;
+    std::thread stats_thread;
+    void start_stats_signal();
+    void stop_stats_signal();
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,203 @@
+#pragma once
+
+// Internals of sql.cpp, shared with the benchmarks. Not part of the
+// resolver's interface, and not installed.
+
+#include <pxr/pxr.h>
+
+#include <pxr/base/tf/token.h>
+
+#include <pxr/usd/ar/asset.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "asset_cache.h"
+#include "backend.h"
+#include "disk_cache.h"
+#include "sql.h"
+#include "stats.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Strips the schema from an sql: or sql:// path.
+std::string parse_path(const std::string& path);
+// Turns sql:// paths into sql: paths, so both map to the same cache entry.
+std::string clean_path(const std::string& path);
+
+// The key can be any type comparable with the pair's first member, so looking
+// up with a const char* doesn't create a temporary std::string.
+template <
+    typename key_t, typename value_t, value_t default_value = value_t(),
+    typename pair_t = std::pair<key_t, value_t>>
+value_t find_in_sorted_vector(
+    const std::vector<pair_t>& vec, const key_t& key) {
+    const auto ret = std::lower_bound(
+        vec.begin(), vec.end(), key,
+        [](const pair_t& a, const key_t& b) { return a.first < b; });
+    if (ret != vec.end() && ret->first == key) {
+        return ret->second;
+    } else {
+        return default_value;
+    }
+}
+
+// Runs queries on a fixed number of threads, started on first use, and hands
+// the results back as futures. Callers can issue many requests at once
+// without creating a thread for each, and only block when they need the
+// result. The number of threads matches the number of backend sessions, as
+// more threads would only wait for a free session.
+class AsyncExecutor {
+public:
+    explicit AsyncExecutor(size_t num_threads) : num_threads(num_threads) {}
+    ~AsyncExecutor();
+
+    AsyncExecutor(const AsyncExecutor&) = delete;
+    AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+    template <typename F, typename result_t = decltype(std::declval<F&>()())>
+    std::future<result_t> submit(F&& f) {
+        // std::function requires copyable callables.
+        auto task = std::make_shared<std::packaged_task<result_t()>>(
+            std::forward<F>(f));
+        auto ret = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (threads.empty()) {
+                for (size_t i = 0; i < num_threads; ++i) {
+                    threads.emplace_back(&AsyncExecutor::worker, this);
+                }
+            }
+            tasks.emplace_back([task]() { (*task)(); });
+        }
+        queue_cv.notify_one();
+        return ret;
+    }
+
+private:
+    void worker();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    size_t num_threads;
+    bool stopping = false;
+};
+
+struct SQLConnection {
+    SQLConnection(const std::string& server_name);
+    // Reads the assets from the given backend instead of the configured one.
+    SQLConnection(
+        const std::string& server_name, std::unique_ptr<Backend> storage);
+    ~SQLConnection();
+
+    AssetCache cached_queries;
+    // Keeps recently used assets in memory, the entries only hold weak
+    // references.
+    AssetLru lru;
+    std::string table_name;
+    // Optional column or expression holding the hash of the data. Assets
+    // with the same hash share their data, which is downloaded only once.
+    const std::string hash_column;
+    AssetHashIndex hash_index;
+    // Optional, shared with other processes. Writes are queued on the
+    // executor, which is destroyed first.
+    std::unique_ptr<DiskCache> disk_cache;
+    // Declared before the backend and the executor, so their threads never
+    // see it destroyed.
+    ServerStats stats;
+    std::unique_ptr<Backend> backend;
+    AsyncExecutor executor;
+    // Cached timestamps confirmed by the server less than this long ago are
+    // trusted without a query. Zero checks with the server every time.
+    const std::chrono::steady_clock::duration revalidate_window;
+    // Assets the server reported missing less than this long ago are reported
+    // missing again without a query. Zero asks the server every time.
+    const std::chrono::steady_clock::duration negative_window;
+    // Assets at least this large are downloaded in parts, as they are read.
+    // Zero always downloads everything.
+    const size_t range_threshold;
+    // Fetch the references of fetched layers in the background.
+    const bool prefetch;
+
+    // Optional background thread, that periodically asks the server for every
+    // row changed since the last poll and marks the affected entries as
+    // outdated. While it keeps up, cached timestamps are trusted without
+    // asking the server for each asset.
+    const std::chrono::steady_clock::duration poll_interval;
+    std::atomic<int64_t> last_poll{0};
+    std::mutex poll_mutex;
+    std::condition_variable poll_cv;
+    bool poll_stop = false;
+    std::thread poll_thread;
+
+    void poll_changes();
+    // Waits for a free session, recording the wait.
+    Backend::Handle acquire();
+    // True if the poller is running and keeps up with the changes.
+    bool is_polling() const;
+    // True if the cached timestamp can be used without asking the server.
+    bool is_up_to_date(const Cache& cache) const;
+    // True if a resolve read the timestamp just now, and it was not used yet.
+    bool is_fresh(const Cache& cache) const;
+    // True if the asset is known to be missing without asking the server.
+    bool is_known_missing(const Cache& cache) const;
+    // True if the asset should be downloaded in parts.
+    bool is_ranged(const Cache& cache) const;
+    // Downloads the whole asset, counting the bytes.
+    std::shared_ptr<ArAsset> fetch(
+        Backend::Session& session, const TfToken& local_path,
+        double& timestamp);
+    // Marks the asset as recently used in the LRU. Ranged assets only hold
+    // the blocks read so far, so they are left to their users instead of
+    // being charged their full size.
+    void touch(const std::shared_ptr<ArAsset>& asset);
+    // Creates an asset fetching the data of the given version on demand,
+    // starting with the first block if it was read already.
+    std::shared_ptr<ArAsset> open_ranged(
+        const TfToken& local_path, double timestamp, size_t size,
+        std::shared_ptr<char> first_block);
+    // Stores the data of a fetched asset in the entry. Has to be called with
+    // the fetch mutex held.
+    void set_fetched(
+        Cache& cache, const std::shared_ptr<ArAsset>& asset, double timestamp);
+    // Stores a newer timestamp reported by the server, so the data is fetched
+    // again. Takes the fetch mutex, so a fetch of the older version finishing
+    // at the same time can't end up with the newer timestamp.
+    void set_newer_timestamp(Cache& cache, double timestamp);
+    // Starts fetching the sql: assets referenced by a fetched layer, before
+    // USD asks for them. The fetched assets prefetch their own references.
+    void prefetch_references(const std::shared_ptr<ArAsset>& asset);
+    // Uses the data in the disk cache, if it holds the given version. Has to
+    // be called with the fetch mutex held.
+    std::shared_ptr<ArAsset> load_from_disk(Cache& cache, double timestamp);
+    // Writes a downloaded asset to the disk cache in the background.
+    void store_on_disk(
+        const TfToken& local_path, const std::shared_ptr<ArAsset>& asset,
+        double timestamp);
+
+    bool find_asset(const std::string& asset_path);
+    double get_timestamp(const std::string& asset_path);
+    std::shared_ptr<ArAsset> open_asset(const std::string& asset_path);
+
+    std::vector<bool> find_assets(const std::vector<std::string>& asset_paths);
+    std::vector<std::shared_ptr<ArAsset>> open_assets(
+        const std::vector<std::string>& asset_paths);
+
+    SQLServerStats get_stats() const;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,492 @@
+#include "sqlite_backend.h"
+
+#include <pxr/base/tf/diagnosticLite.h>
+#include <pxr/base/trace/trace.h>
+
+#ifdef USD_SQL_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "compression.h"
+#include "debug_codes.h"
+#include "memory_asset.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+#ifdef USD_SQL_SQLITE
+
+namespace {
+
+constexpr auto DB_ENV_VAR = "USD_SQL_DB";
+constexpr auto POOL_SIZE_ENV_VAR = "USD_SQL_POOL_SIZE";
+
+// Milliseconds a query waits for a writer to finish before failing.
+constexpr int BUSY_TIMEOUT_MS = 5000;
+
+// Timestamps can be stored as seconds since the epoch, or as text in any
+// format understood by julianday, like CURRENT_TIMESTAMP. Text is converted to
+// seconds with millisecond precision.
+constexpr auto TIMESTAMP_SECONDS =
+    "(CASE WHEN typeof(timestamp) IN ('integer', 'real') THEN timestamp "
+    "ELSE round((julianday(timestamp) - 2440587.5) * 86400000.0) / 1000.0 "
+    "END)";
+
+enum QueryKind {
+    QUERY_RESOLVE,
+    QUERY_TIMESTAMP,
+    QUERY_DATA,
+    QUERY_DATA_IF_NEWER,
+    QUERY_RANGE,
+    QUERY_HASH,
+    QUERY_LATEST_CHANGE,
+    QUERY_CHANGES,
+    QUERY_COUNT
+};
+
+using QueryStrings = std::array<std::string, QUERY_COUNT>;
+
+// The hash query is left empty, and never used, without a hash column.
+QueryStrings make_query_strings(
+    const std::string& table_name, const std::string& hash_column) {
+    const std::string timestamp = TIMESTAMP_SECONDS;
+    QueryStrings queries;
+    queries[QUERY_RESOLVE] = "SELECT " + timestamp + ", length(data) FROM " +
+                             table_name + " WHERE path = ? LIMIT 1";
+    queries[QUERY_TIMESTAMP] = "SELECT " + timestamp + " FROM " + table_name +
+                               " WHERE path = ? LIMIT 1";
+    queries[QUERY_DATA] = "SELECT data, " + timestamp + " FROM " +
+                          table_name + " WHERE path = ? LIMIT 1";
+    queries[QUERY_DATA_IF_NEWER] = "SELECT data, " + timestamp + " FROM " +
+                                   table_name + " WHERE path = ? AND " +
+                                   timestamp + " > ? LIMIT 1";
+    // substr counts from 1.
+    queries[QUERY_RANGE] = "SELECT substr(data, ? + 1, ?), " + timestamp +
+                           " FROM " + table_name + " WHERE path = ? LIMIT 1";
+    if (!hash_column.empty()) {
+        queries[QUERY_HASH] = "SELECT " + hash_column + ", " + timestamp +
+                              " FROM " + table_name +
+                              " WHERE path = ? LIMIT 1";
+    }
+    queries[QUERY_LATEST_CHANGE] =
+        "SELECT MAX(" + timestamp + ") FROM " + table_name;
+    queries[QUERY_CHANGES] = "SELECT path, " + timestamp + " FROM " +
+                             table_name + " WHERE " + timestamp + " >= ?";
+    return queries;
+}
+
+double column_time(sqlite3_stmt* statement, int column) {
+    return sqlite3_column_type(statement, column) == SQLITE_NULL
+               ? INVALID_TIME
+               : sqlite3_column_double(statement, column);
+}
+
+std::string column_string(sqlite3_stmt* statement, int column) {
+    const auto* text = sqlite3_column_text(statement, column);
+    const auto length = sqlite3_column_bytes(statement, column);
+    return text == nullptr
+               ? std::string()
+               : std::string(reinterpret_cast<const char*>(text), length);
+}
+
+// Copies a blob column into the buffer of a new MemoryAsset, decompressing it
+// if needed.
+std::shared_ptr<ArAsset> column_asset(sqlite3_stmt* statement, int column) {
+    const auto* blob =
+        static_cast<const char*>(sqlite3_column_blob(statement, column));
+    const auto length =
+        static_cast<size_t>(sqlite3_column_bytes(statement, column));
+    const auto compressed = is_compressed(blob, length);
+    const auto size =
+        compressed ? decompressed_size(blob, length) : length;
+    if (compressed && size == 0) {
+        SQL_WARN(
+            "[SQLResolver] Can't decompress asset, %s",
+            compression_supported() ? "the size is not stored"
+                                    : "zstd support was not built");
+        return nullptr;
+    }
+    int fd = -1;
+    std::shared_ptr<char> data;
+    {
+        TRACE_SCOPE("MemoryAsset construction");
+        data = allocate_asset_buffer(size, fd);
+    }
+    if (size > 0 && data == nullptr) {
+        SQL_WARN(
+            "[SQLResolver] Failed allocating %zu bytes for an asset", size);
+        return nullptr;
+    }
+    TRACE_COUNTER_DELTA("SQL bytes transferred", length);
+    if (!compressed) {
+        TRACE_SCOPE("SQLite result transfer");
+        if (size > 0) { memcpy(data.get(), blob, size); }
+    } else if (!decompress(blob, length, data.get(), size)) {
+        SQL_WARN("[SQLResolver] Failed decompressing asset");
+        close_asset_fd(fd);
+        return nullptr;
+    }
+    return std::make_shared<MemoryAsset>(std::move(data), size, fd);
+}
+
+// Resets a statement and clears its parameters when going out of scope, so
+// it can be executed again.
+struct StatementReset {
+    explicit StatementReset(sqlite3_stmt* statement) : statement(statement) {}
+    ~StatementReset() {
+        sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+    }
+
+    StatementReset(const StatementReset&) = delete;
+    StatementReset& operator=(const StatementReset&) = delete;
+
+    sqlite3_stmt* statement;
+};
+
+// A read only connection to the database, with the statements prepared on
+// first use.
+class SQLiteSession final : public Backend::Session {
+public:
+    SQLiteSession(sqlite3* db, std::shared_ptr<const QueryStrings> queries)
+        : db(db), queries(std::move(queries)) {}
+    ~SQLiteSession() override {
+        for (auto* statement : statements) { sqlite3_finalize(statement); }
+        sqlite3_close(db);
+    }
+
+    SQLiteSession(const SQLiteSession&) = delete;
+    SQLiteSession& operator=(const SQLiteSession&) = delete;
+
+    ResolveResult resolve(
+        const TfToken& asset_path, double& timestamp, size_t& size) override;
+    double get_timestamp(const TfToken& asset_path) override;
+    std::shared_ptr<ArAsset> fetch(
+        const TfToken& asset_path, double& timestamp) override;
+    ResolveResult fetch_if_newer(
+        const TfToken& asset_path, double since,
+        std::shared_ptr<ArAsset>& asset, double& timestamp) override;
+    bool fetch_range(
+        const TfToken& asset_path, double timestamp, size_t offset,
+        size_t size, char* buffer) override;
+    bool hash(
+        const TfToken& asset_path, std::string& hash,
+        double& timestamp) override;
+    // SQLite queries don't leave the process, so the batches are single
+    // queries in a loop.
+    void resolve_batch(
+        const std::vector<TfToken>& asset_paths,
+        const ResolveCallback& on_result) override;
+    void fetch_batch(
+        const std::vector<TfToken>& asset_paths,
+        const FetchCallback& on_fetched) override;
+    void hash_batch(
+        const std::vector<TfToken>& asset_paths,
+        const HashCallback& on_hash) override;
+    bool latest_change(double& high_water) override;
+    bool changes(double& high_water, const ChangeCallback& on_change) override;
+
+private:
+    // Returns the prepared statement, or nullptr if preparing failed.
+    sqlite3_stmt* prepare(QueryKind kind);
+    // Steps to the next row, returns SQLITE_ROW, SQLITE_DONE, or the error.
+    // The row is read from the database file while stepping.
+    int step(sqlite3_stmt* statement, QueryKind kind);
+    // Prepares the statement, binds the path to the first parameter and
+    // steps to the first row.
+    int query_path(
+        QueryKind kind, const TfToken& asset_path, sqlite3_stmt*& statement);
+
+    sqlite3* db;
+    const std::shared_ptr<const QueryStrings> queries;
+    std::array<sqlite3_stmt*, QUERY_COUNT> statements{};
+};
+
+sqlite3_stmt* SQLiteSession::prepare(QueryKind kind) {
+    auto*& statement = statements[kind];
+    if (statement != nullptr) { return statement; }
+    const auto& query = (*queries)[kind];
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLiteSession::prepare: query:\n%s\n", query.c_str());
+    if (sqlite3_prepare_v2(
+            db, query.c_str(), static_cast<int>(query.size()), &statement,
+            nullptr) != SQLITE_OK) {
+        SQL_WARN(
+            "[SQLResolver] Error preparing statement: %s\nError string: %s",
+            query.c_str(), sqlite3_errmsg(db));
+        sqlite3_finalize(statement);
+        statement = nullptr;
+    }
+    return statement;
+}
+
+int SQLiteSession::step(sqlite3_stmt* statement, QueryKind kind) {
+    TRACE_SCOPE("SQLite query");
+    const auto ret = sqlite3_step(statement);
+    if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+        SQL_WARN(
+            "[SQLResolver] Error executing statement: %s\nError code: "
+            "%i\nError string: %s",
+            (*queries)[kind].c_str(), ret, sqlite3_errmsg(db));
+    }
+    return ret;
+}
+
+int SQLiteSession::query_path(
+    QueryKind kind, const TfToken& asset_path, sqlite3_stmt*& statement) {
+    statement = prepare(kind);
+    if (statement == nullptr) { return SQLITE_ERROR; }
+    // The token outlives the statement execution.
+    const auto& path = asset_path.GetString();
+    if (sqlite3_bind_text(
+            statement, 1, path.c_str(), static_cast<int>(path.size()),
+            SQLITE_STATIC) != SQLITE_OK) {
+        return SQLITE_ERROR;
+    }
+    return step(statement, kind);
+}
+
+ResolveResult SQLiteSession::resolve(
+    const TfToken& asset_path, double& timestamp, size_t& size) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLiteSession::resolve: querying '%s'\n", asset_path.GetText());
+    sqlite3_stmt* statement = nullptr;
+    const auto ret = query_path(QUERY_RESOLVE, asset_path, statement);
+    if (statement == nullptr) { return RESOLVE_FAILED; }
+    StatementReset reset(statement);
+    if (ret == SQLITE_DONE) { return RESOLVE_MISSING; }
+    if (ret != SQLITE_ROW) { return RESOLVE_FAILED; }
+    timestamp = column_time(statement, 0);
+    size = static_cast<size_t>(sqlite3_column_int64(statement, 1));
+    return RESOLVE_FOUND;
+}
+
+double SQLiteSession::get_timestamp(const TfToken& asset_path) {
+    sqlite3_stmt* statement = nullptr;
+    const auto ret = query_path(QUERY_TIMESTAMP, asset_path, statement);
+    if (statement == nullptr) { return INVALID_TIME; }
+    StatementReset reset(statement);
+    return ret == SQLITE_ROW ? column_time(statement, 0) : INVALID_TIME;
+}
+
+std::shared_ptr<ArAsset> SQLiteSession::fetch(
+    const TfToken& asset_path, double& timestamp) {
+    TF_DEBUG(USD_URI_SQL_RESOLVER)
+        .Msg("SQLiteSession::fetch: fetching '%s'\n", asset_path.GetText());
+    sqlite3_stmt* statement = nullptr;
+    const auto ret = query_path(QUERY_DATA, asset_path, statement);
+    if (statement == nullptr) { return nullptr; }
+    StatementReset reset(statement);
+    if (ret != SQLITE_ROW ||
+        sqlite3_column_type(statement, 0) == SQLITE_NULL) {
+        return nullptr;
+    }
+    timestamp = column_time(statement, 1);
+    return column_asset(statement, 0);
+}
+
+ResolveResult SQLiteSession::fetch_if_newer(
+    const TfToken& asset_path, double since, std::shared_ptr<ArAsset>& asset,
+    double& timestamp) {
+    auto* statement = prepare(QUERY_DATA_IF_NEWER);
+    if (statement == nullptr) { return RESOLVE_FAILED; }
+    StatementReset reset(statement);
+    const auto& path = asset_path.GetString();
+    if (sqlite3_bind_text(
+            statement, 1, path.c_str(), static_cast<int>(path.size()),
+            SQLITE_STATIC) != SQLITE_OK ||
+        sqlite3_bind_double(statement, 2, since) != SQLITE_OK) {
+        return RESOLVE_FAILED;
+    }
+    const auto ret = step(statement, QUERY_DATA_IF_NEWER);
+    if (ret == SQLITE_DONE) { return RESOLVE_MISSING; }
+    if (ret != SQLITE_ROW ||
+        sqlite3_column_type(statement, 0) == SQLITE_NULL) {
+        return RESOLVE_FAILED;
+    }
+    timestamp = column_time(statement, 1);
+    asset = column_asset(statement, 0);
+    return asset == nullptr ? RESOLVE_FAILED : RESOLVE_FOUND;
+}
+
+bool SQLiteSession::fetch_range(
+    const TfToken& asset_path, double timestamp, size_t offset, size_t size,
+    char* buffer) {
+    auto* statement = prepare(QUERY_RANGE);
+    if (statement == nullptr) { return false; }
+    StatementReset reset(statement);
+    const auto& path = asset_path.GetString();
+    if (sqlite3_bind_int64(
+            statement, 1, static_cast<sqlite3_int64>(offset)) != SQLITE_OK ||
+        sqlite3_bind_int64(statement, 2, static_cast<sqlite3_int64>(size)) !=
+            SQLITE_OK ||
+        sqlite3_bind_text(
+            statement, 3, path.c_str(), static_cast<int>(path.size()),
+            SQLITE_STATIC) != SQLITE_OK) {
+        return false;
+    }
+    if (step(statement, QUERY_RANGE) != SQLITE_ROW) { return false; }
+    const auto* data =
+        static_cast<const char*>(sqlite3_column_blob(statement, 0));
+    const auto length =
+        static_cast<size_t>(sqlite3_column_bytes(statement, 0));
+    if (column_time(statement, 1) != timestamp || length != size) {
+        TF_DEBUG(USD_URI_SQL_RESOLVER)
+            .Msg(
+                "SQLiteSession::fetch_range: '%s' changed since it was "
+                "opened\n",
+                asset_path.GetText());
+        return false;
+    }
+    TRACE_SCOPE("SQLite result transfer");
+    TRACE_COUNTER_DELTA("SQL bytes transferred", length);
+    if (length > 0) { memcpy(buffer, data, length); }
+    return true;
+}
+
+bool SQLiteSession::hash(
+    const TfToken& asset_path, std::string& hash, double& timestamp) {
+    sqlite3_stmt* statement = nullptr;
+    const auto ret = query_path(QUERY_HASH, asset_path, statement);
+    if (statement == nullptr) { return false; }
+    StatementReset reset(statement);
+    if (ret != SQLITE_ROW ||
+        sqlite3_column_type(statement, 0) == SQLITE_NULL ||
+        sqlite3_column_type(statement, 1) == SQLITE_NULL) {
+        return false;
+    }
+    hash = column_string(statement, 0);
+    timestamp = column_time(statement, 1);
+    return !hash.empty();
+}
+
+void SQLiteSession::resolve_batch(
+    const std::vector<TfToken>& asset_paths,
+    const ResolveCallback& on_result) {
+    std::unordered_set<TfToken, TfToken::HashFunctor> reported;
+    for (const auto& asset_path : asset_paths) {
+        if (!reported.insert(asset_path).second) { continue; }
+        auto timestamp = INVALID_TIME;
+        size_t size = 0;
+        const auto result = resolve(asset_path, timestamp, size);
+        if (result != RESOLVE_FAILED) {
+            on_result(asset_path.GetString(), result, timestamp, size);
+        }
+    }
+}
+
+void SQLiteSession::fetch_batch(
+    const std::vector<TfToken>& asset_paths,
+    const FetchCallback& on_fetched) {
+    std::unordered_set<TfToken, TfToken::HashFunctor> reported;
+    for (const auto& asset_path : asset_paths) {
+        if (!reported.insert(asset_path).second) { continue; }
+        auto timestamp = INVALID_TIME;
+        const auto asset = fetch(asset_path, timestamp);
+        if (asset != nullptr) {
+            on_fetched(asset_path.GetString(), asset, timestamp);
+        }
+    }
+}
+
+void SQLiteSession::hash_batch(
+    const std::vector<TfToken>& asset_paths, const HashCallback& on_hash) {
+    std::unordered_set<TfToken, TfToken::HashFunctor> reported;
+    std::string asset_hash;
+    for (const auto& asset_path : asset_paths) {
+        if (!reported.insert(asset_path).second) { continue; }
+        auto timestamp = INVALID_TIME;
+        if (hash(asset_path, asset_hash, timestamp)) {
+            on_hash(asset_path.GetString(), asset_hash, timestamp);
+        }
+    }
+}
+
+bool SQLiteSession::latest_change(double& high_water) {
+    auto* statement = prepare(QUERY_LATEST_CHANGE);
+    if (statement == nullptr) { return false; }
+    StatementReset reset(statement);
+    if (step(statement, QUERY_LATEST_CHANGE) != SQLITE_ROW) { return false; }
+    // An empty table has no latest change.
+    const auto latest = column_time(statement, 0);
+    if (latest != INVALID_TIME) { high_water = latest; }
+    return true;
+}
+
+bool SQLiteSession::changes(
+    double& high_water, const ChangeCallback& on_change) {
+    auto* statement = prepare(QUERY_CHANGES);
+    if (statement == nullptr) { return false; }
+    StatementReset reset(statement);
+    if (sqlite3_bind_double(statement, 1, high_water) != SQLITE_OK) {
+        return false;
+    }
+    auto latest = high_water;
+    auto ret = SQLITE_ROW;
+    while ((ret = step(statement, QUERY_CHANGES)) == SQLITE_ROW) {
+        const auto stamp = column_time(statement, 1);
+        if (stamp == INVALID_TIME) { continue; }
+        latest = std::max(latest, stamp);
+        on_change(column_string(statement, 0), stamp);
+    }
+    // Rows after a failed step were not seen, so we poll them again.
+    if (ret != SQLITE_DONE) { return false; }
+    high_water = latest;
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<Backend> make_sqlite_backend(
+    const std::string& server_name, const std::string& table_name,
+    const std::string& hash_column) {
+    const auto db_path = get_env_var(server_name, DB_ENV_VAR, "usd.db");
+    const auto pool_size = static_cast<size_t>(std::max(
+        1, atoi(get_env_var(server_name, POOL_SIZE_ENV_VAR, "4").c_str())));
+    std::shared_ptr<const QueryStrings> queries =
+        std::make_shared<QueryStrings>(
+            make_query_strings(table_name, hash_column));
+    return std::unique_ptr<Backend>(new Backend(
+        server_name, pool_size,
+        [db_path, queries]() -> std::unique_ptr<Backend::Session> {
+            sqlite3* db = nullptr;
+            // Each session is only used by one thread at a time.
+            if (sqlite3_open_v2(
+                    db_path.c_str(), &db,
+                    SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                    nullptr) != SQLITE_OK) {
+                SQL_WARN(
+                    "[SQLResolver] Failed to open: %s\nReason: %s",
+                    db_path.c_str(),
+                    db != nullptr ? sqlite3_errmsg(db) : "out of memory");
+                sqlite3_close(db);
+                return nullptr;
+            }
+            // Waits for writers instead of failing the query right away.
+            sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+            return std::unique_ptr<Backend::Session>(
+                new SQLiteSession(db, queries));
+        }));
+}
+
+#else // USD_SQL_SQLITE
+
+std::unique_ptr<Backend> make_sqlite_backend(
+    const std::string& server_name, const std::string& table_name,
+    const std::string& hash_column) {
+    SQL_WARN(
+        "[SQLResolver] Can't open %s, sqlite support was not built",
+        server_name.c_str());
+    return std::unique_ptr<Backend>(new Backend(
+        server_name, 1,
+        []() -> std::unique_ptr<Backend::Session> { return nullptr; }));
+}
+
+#endif // USD_SQL_SQLITE
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "histogram.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Outcomes of the lookups, named after the state of the cache entry, and the
+// amount of data moved.
+enum StatCounter {
+    // find_asset
+    STAT_RESOLVE_HIT,
+    STAT_RESOLVE_MISSING_HIT,
+    STAT_RESOLVE_MISS,
+    // get_timestamp
+    STAT_TIMESTAMP_FRESH_HIT,
+    STAT_TIMESTAMP_HIT,
+    STAT_TIMESTAMP_MISS,
+    STAT_TIMESTAMP_UNRESOLVED,
+    // open_asset
+    STAT_OPEN_HIT,
+    STAT_OPEN_NOT_MODIFIED,
+    STAT_OPEN_EVICTED,
+    STAT_OPEN_DISK_HIT,
+    STAT_OPEN_HASH_HIT,
+    STAT_OPEN_FETCHED,
+    STAT_OPEN_RANGED,
+    STAT_OPEN_FAILED,
+    // Asset data, after decompression.
+    STAT_BYTES_FETCHED,
+    STAT_BYTES_RANGED,
+    STAT_BYTES_FROM_DISK,
+    STAT_COUNTER_COUNT
+};
+
+// Round trips to the storage, by the session call making them.
+enum StatQuery {
+    STAT_QUERY_RESOLVE,
+    STAT_QUERY_TIMESTAMP,
+    STAT_QUERY_FETCH,
+    STAT_QUERY_FETCH_IF_NEWER,
+    STAT_QUERY_RANGE,
+    STAT_QUERY_HASH,
+    STAT_QUERY_RESOLVE_BATCH,
+    STAT_QUERY_FETCH_BATCH,
+    STAT_QUERY_HASH_BATCH,
+    STAT_QUERY_POLL,
+    STAT_QUERY_COUNT
+};
+
+enum StatWait {
+    // Waiting for a free backend session.
+    STAT_WAIT_SESSION,
+    // Waiting for another thread fetching the same asset.
+    STAT_WAIT_FETCH,
+    STAT_WAIT_COUNT
+};
+
+constexpr const char* STAT_COUNTER_NAMES[STAT_COUNTER_COUNT] = {
+    "resolve_hit",         "resolve_missing_hit", "resolve_miss",
+    "timestamp_fresh_hit", "timestamp_hit",       "timestamp_miss",
+    "timestamp_unresolved", "open_hit",           "open_not_modified",
+    "open_evicted",        "open_disk_hit",       "open_hash_hit",
+    "open_fetched",        "open_ranged",         "open_failed",
+    "bytes_fetched",       "bytes_ranged",        "bytes_from_disk"};
+
+constexpr const char* STAT_QUERY_NAMES[STAT_QUERY_COUNT] = {
+    "query_resolve",       "query_timestamp",  "query_fetch",
+    "query_fetch_if_newer", "query_range",     "query_hash",
+    "query_resolve_batch", "query_fetch_batch", "query_hash_batch",
+    "query_poll"};
+
+constexpr const char* STAT_WAIT_NAMES[STAT_WAIT_COUNT] = {
+    "wait_session", "wait_fetch"};
+
+// Counters and latencies of a single server, in nanoseconds. Everything is
+// updated with relaxed atomics, so recording never blocks, and readers see
+// each value on its own, not a consistent snapshot of all of them. Counters
+// are bumped on every cache hit, so they are striped over cache lines to keep
+// threads from contending on them.
+class ServerStats {
+public:
+    ServerStats() { reset(); }
+
+    ServerStats(const ServerStats&) = delete;
+    ServerStats& operator=(const ServerStats&) = delete;
+
+    // Records the time from construction to destruction.
+    class Timer {
+    public:
+        explicit Timer(Histogram& histogram)
+            : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            histogram.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count()));
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Histogram& histogram;
+        const std::chrono::steady_clock::time_point start;
+    };
+
+    void add(StatCounter counter, uint64_t value = 1) {
+        stripes[stripe_index()].counters[counter].fetch_add(
+            value, std::memory_order_relaxed);
+    }
+
+    uint64_t get(StatCounter counter) const {
+        uint64_t ret = 0;
+        for (const auto& stripe : stripes) {
+            ret += stripe.counters[counter].load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    // Runs a query, and records how long it took.
+    template <typename F>
+    auto query(StatQuery kind, F&& f) -> decltype(f()) {
+        Timer timer(queries[kind]);
+        return f();
+    }
+
+    void reset() {
+        for (auto& stripe : stripes) {
+            for (auto& counter : stripe.counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto& histogram : queries) { histogram.reset(); }
+        for (auto& histogram : waits) { histogram.reset(); }
+    }
+
+    std::array<Histogram, STAT_QUERY_COUNT> queries;
+    std::array<Histogram, STAT_WAIT_COUNT> waits;
+
+private:
+    static constexpr size_t STRIPE_COUNT = 16;
+
+    // The padding keeps neighbouring stripes off each other's cache lines,
+    // without needing an over-aligned allocation.
+    struct Stripe {
+        std::array<std::atomic<uint64_t>, STAT_COUNTER_COUNT> counters;
+        char padding[64];
+    };
+
+    // Threads are spread over the stripes in the order they first count.
+    static size_t stripe_index() {
+        static std::atomic<size_t> next_stripe{0};
+        thread_local const size_t index =
+            next_stripe.fetch_add(1, std::memory_order_relaxed) %
+            STRIPE_COUNT;
+        return index;
+    }
+
+    std::array<Stripe, STRIPE_COUNT> stripes;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
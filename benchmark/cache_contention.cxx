@@ -0,0 +1,110 @@
+#include <pxr/base/tf/stringUtils.h>
+
+#include "asset_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+// Measures how cache hit throughput scales with the number of threads looking
+// up assets in the same AssetCache. Like the resolver, every lookup starts
+// from a string path, so the token registry is part of what is measured.
+//
+// Usage: cache_contention [max_threads] [num_assets] [lookups_per_thread]
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// Cheap pseudo random generator, so the benchmark doesn't measure rand().
+inline uint32_t xorshift(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+double run(
+    const AssetCache& cache, const std::vector<std::string>& paths,
+    size_t num_threads, size_t lookups_per_thread) {
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::atomic<size_t> total_hits{0};
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i]() {
+            uint32_t state = static_cast<uint32_t>(i * 7919 + 1);
+            size_t hits = 0;
+            ready.fetch_add(1);
+            while (!start.load()) { std::this_thread::yield(); }
+            for (size_t l = 0; l < lookups_per_thread; ++l) {
+                const auto& path = paths[xorshift(state) % paths.size()];
+                const auto* entry = cache.find(TfToken(path));
+                if (entry != nullptr && entry->state == CACHE_FETCHED) {
+                    ++hits;
+                }
+            }
+            total_hits.fetch_add(hits);
+        });
+    }
+
+    while (ready.load() != num_threads) { std::this_thread::yield(); }
+    const auto begin = clock_type::now();
+    start.store(true);
+    for (auto& thread : threads) { thread.join(); }
+    const std::chrono::duration<double> elapsed = clock_type::now() - begin;
+
+    if (total_hits.load() != num_threads * lookups_per_thread) {
+        fprintf(stderr, "Unexpected cache misses!\n");
+    }
+    return static_cast<double>(num_threads * lookups_per_thread) /
+           elapsed.count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const size_t max_threads =
+        argc > 1 ? static_cast<size_t>(atoi(argv[1]))
+                 : std::max(1u, std::thread::hardware_concurrency());
+    const size_t num_assets =
+        argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 10000;
+    const size_t lookups_per_thread =
+        argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 1 << 22;
+
+    AssetCache cache;
+    std::vector<std::string> paths;
+    paths.reserve(num_assets);
+    for (size_t i = 0; i < num_assets; ++i) {
+        paths.emplace_back(TfStringPrintf("sql:/benchmark/asset%zu.usda", i));
+        auto* entry = cache.insert(
+            TfToken(paths.back()),
+            TfToken(TfStringPrintf("/benchmark/asset%zu.usda", i)));
+        entry->state = CACHE_FETCHED;
+    }
+
+    printf("%8s %16s %16s %8s\n", "threads", "hits/s", "hits/s/thread", "scale");
+    double single_thread = 0.0;
+    for (size_t num_threads = 1; num_threads <= max_threads;
+         num_threads = num_threads == max_threads
+                           ? max_threads + 1
+                           : std::min(num_threads * 2, max_threads)) {
+        const auto throughput =
+            run(cache, paths, num_threads, lookups_per_thread);
+        if (num_threads == 1) { single_thread = throughput; }
+        printf(
+            "%8zu %16.0f %16.0f %8.2f\n", num_threads, throughput,
+            throughput / num_threads, throughput / single_thread);
+    }
+
+    return 0;
+}
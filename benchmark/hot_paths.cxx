@@ -0,0 +1,291 @@
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "memory_asset.h"
+#include "mysql_time.h"
+#include "sql_internal.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+// Measures the CPU cost of the paths USD calls for every asset, in ns/op and
+// allocations/op. The connections read from a stub backend answering from
+// memory, so the cache hits and the resolver's side of the queries are
+// measured without a server.
+//
+// Usage: hot_paths [iterations] [num_assets]
+
+namespace {
+
+std::atomic<size_t> allocation_count{0};
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto* ret = malloc(size == 0 ? 1 : size);
+    if (ret == nullptr) { throw std::bad_alloc(); }
+    return ret;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+
+void operator delete[](void* ptr) noexcept { free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr auto CACHED_SERVER = "hot_paths_cached";
+constexpr auto QUERIED_SERVER = "hot_paths_queried";
+constexpr double STUB_TIMESTAMP = 1000000000.0;
+
+// Every asset ending in .usda exists, with the same data and timestamp, and
+// never changes.
+class StubSession final : public Backend::Session {
+public:
+    explicit StubSession(std::shared_ptr<ArAsset> data)
+        : data(std::move(data)) {}
+
+    ResolveResult resolve(
+        const TfToken& asset_path, double& timestamp, size_t& size) override {
+        if (!exists(asset_path)) { return RESOLVE_MISSING; }
+        timestamp = STUB_TIMESTAMP;
+        size = data->GetSize();
+        return RESOLVE_FOUND;
+    }
+    double get_timestamp(const TfToken& asset_path) override {
+        return exists(asset_path) ? STUB_TIMESTAMP : INVALID_TIME;
+    }
+    std::shared_ptr<ArAsset> fetch(
+        const TfToken& asset_path, double& timestamp) override {
+        if (!exists(asset_path)) { return nullptr; }
+        timestamp = STUB_TIMESTAMP;
+        return data;
+    }
+    ResolveResult fetch_if_newer(
+        const TfToken& asset_path, double since,
+        std::shared_ptr<ArAsset>& asset, double& timestamp) override {
+        if (!exists(asset_path) || since >= STUB_TIMESTAMP) {
+            return RESOLVE_MISSING;
+        }
+        asset = fetch(asset_path, timestamp);
+        return RESOLVE_FOUND;
+    }
+    bool fetch_range(
+        const TfToken& asset_path, double timestamp, size_t offset,
+        size_t size, char* buffer) override {
+        return exists(asset_path) && timestamp == STUB_TIMESTAMP &&
+               data->Read(buffer, size, offset) == size;
+    }
+    bool hash(
+        const TfToken& asset_path, std::string& hash,
+        double& timestamp) override {
+        return false;
+    }
+    void resolve_batch(
+        const std::vector<TfToken>& asset_paths,
+        const ResolveCallback& on_result) override {
+        for (const auto& path : asset_paths) {
+            double timestamp = INVALID_TIME;
+            size_t size = 0;
+            const auto result = resolve(path, timestamp, size);
+            on_result(path.GetString(), result, timestamp, size);
+        }
+    }
+    void fetch_batch(
+        const std::vector<TfToken>& asset_paths,
+        const FetchCallback& on_fetched) override {
+        for (const auto& path : asset_paths) {
+            double timestamp = INVALID_TIME;
+            auto asset = fetch(path, timestamp);
+            if (asset != nullptr) {
+                on_fetched(path.GetString(), asset, timestamp);
+            }
+        }
+    }
+    void hash_batch(
+        const std::vector<TfToken>& asset_paths,
+        const HashCallback& on_hash) override {}
+    bool latest_change(double& high_water) override {
+        high_water = STUB_TIMESTAMP;
+        return true;
+    }
+    bool changes(
+        double& high_water, const ChangeCallback& on_change) override {
+        return true;
+    }
+
+private:
+    static bool exists(const TfToken& asset_path) {
+        return TfStringEndsWith(asset_path.GetString(), ".usda");
+    }
+
+    std::shared_ptr<ArAsset> data;
+};
+
+std::unique_ptr<Backend> make_stub_backend(
+    const std::string& name, const std::shared_ptr<ArAsset>& data) {
+    return std::unique_ptr<Backend>(
+        new Backend(name, 1, [data]() -> std::unique_ptr<Backend::Session> {
+            return std::unique_ptr<Backend::Session>(new StubSession(data));
+        }));
+}
+
+// Stops the compiler from optimizing away results that are never used.
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename F>
+void measure(const char* name, size_t iterations, F&& f) {
+    f();
+    const auto allocations_before =
+        allocation_count.load(std::memory_order_relaxed);
+    const auto begin = clock_type::now();
+    for (size_t i = 0; i < iterations; ++i) { f(); }
+    const std::chrono::duration<double, std::nano> elapsed =
+        clock_type::now() - begin;
+    const auto allocations =
+        allocation_count.load(std::memory_order_relaxed) - allocations_before;
+    printf(
+        "%-36s %12.1f %12.2f\n", name, elapsed.count() / iterations,
+        static_cast<double>(allocations) / iterations);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const size_t iterations =
+        argc > 1 ? static_cast<size_t>(atoi(argv[1])) : 1 << 20;
+    const size_t num_assets =
+        argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 1000;
+
+    // One connection trusts its cache for an hour, so only hits are
+    // measured, the other asks the backend every time.
+    setenv(
+        TfStringPrintf("%s_USD_SQL_REVALIDATE_MS", CACHED_SERVER).c_str(),
+        "3600000", 1);
+    const std::string data(4096, 'a');
+    const std::shared_ptr<ArAsset> stub_data =
+        std::make_shared<MemoryAsset>(data.c_str(), data.size());
+    SQLResolver resolver;
+    SQLConnection connection(
+        CACHED_SERVER, make_stub_backend(CACHED_SERVER, stub_data));
+    SQLConnection queried(
+        QUERIED_SERVER, make_stub_backend(QUERIED_SERVER, stub_data));
+
+    std::vector<std::string> paths;
+    std::vector<std::string> missing_paths;
+    std::vector<std::shared_ptr<ArAsset>> assets;
+    paths.reserve(num_assets);
+    missing_paths.reserve(num_assets);
+    assets.reserve(num_assets * 2);
+    for (size_t i = 0; i < num_assets; ++i) {
+        paths.push_back(TfStringPrintf("sql:/benchmark/asset%zu.usda", i));
+        missing_paths.push_back(
+            TfStringPrintf("sql:/benchmark/missing%zu.usdc", i));
+        // Kept alive, so the opens never download again.
+        for (auto* conn : {&connection, &queried}) {
+            conn->find_asset(paths.back());
+            assets.push_back(conn->open_asset(paths.back()));
+        }
+    }
+
+    std::vector<std::pair<std::string, SQLConnection*>> servers = {
+        {"sv-dev01", nullptr},
+        {"sv-dev02", nullptr},
+        {"sv-prod01", nullptr},
+        {CACHED_SERVER, &connection}};
+    std::sort(servers.begin(), servers.end());
+
+    MYSQL_TIME mysql_time = {};
+    mysql_time.year = 2020;
+    mysql_time.month = 6;
+    mysql_time.day = 15;
+    mysql_time.hour = 12;
+    mysql_time.minute = 30;
+    mysql_time.second = 45;
+    mysql_time.second_part = 500000;
+
+    const std::string long_path = "sql://benchmark/asset0.usda";
+    const std::string& short_path = paths.front();
+    const std::string file_path = "/benchmark/asset0.usda";
+    size_t next = 0;
+    const auto next_path = [&]() -> const std::string& {
+        next = next + 1 == num_assets ? 0 : next + 1;
+        return paths[next];
+    };
+    const auto next_missing_path = [&]() -> const std::string& {
+        next = next + 1 == num_assets ? 0 : next + 1;
+        return missing_paths[next];
+    };
+
+    printf("%-36s %12s %12s\n", "benchmark", "ns/op", "allocs/op");
+    measure("matches_schema sql:", iterations, [&]() {
+        keep(resolver.matches_schema(short_path));
+    });
+    measure("matches_schema file", iterations, [&]() {
+        keep(resolver.matches_schema(file_path));
+    });
+    measure("clean_path sql://", iterations, [&]() {
+        keep(clean_path(long_path));
+    });
+    measure("clean_path sql:", iterations, [&]() {
+        keep(clean_path(short_path));
+    });
+    measure("parse_path", iterations, [&]() {
+        keep(parse_path(short_path));
+    });
+    measure("TfToken existing", iterations, [&]() {
+        keep(TfToken(next_path()));
+    });
+    measure("find_in_sorted_vector", iterations, [&]() {
+        keep(find_in_sorted_vector<
+             const char*, SQLConnection*, nullptr,
+             std::pair<std::string, SQLConnection*>>(servers, CACHED_SERVER));
+    });
+    measure("convert_mysql_time", iterations, [&]() {
+        keep(convert_mysql_time(mysql_time));
+    });
+    measure("convert_to_mysql_time", iterations, [&]() {
+        MYSQL_TIME converted;
+        keep(convert_to_mysql_time(1592224245.5, converted));
+        keep(converted);
+    });
+    measure("SQLConnection::find_asset hit", iterations, [&]() {
+        keep(connection.find_asset(next_path()));
+    });
+    measure("SQLConnection::get_timestamp hit", iterations, [&]() {
+        keep(connection.get_timestamp(next_path()));
+    });
+    measure("SQLConnection::open_asset hit", iterations, [&]() {
+        keep(connection.open_asset(next_path()));
+    });
+    measure("SQLConnection::find_asset missing", iterations, [&]() {
+        keep(queried.find_asset(next_missing_path()));
+    });
+    measure("SQLConnection::get_timestamp query", iterations, [&]() {
+        keep(queried.get_timestamp(next_path()));
+    });
+    measure("SQLConnection::open_asset unchanged", iterations, [&]() {
+        keep(queried.open_asset(next_path()));
+    });
+
+    return 0;
+}
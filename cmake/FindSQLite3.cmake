@@ -0,0 +1,22 @@
+# Finds the SQLite library.
+#
+# Set SQLITE3_ROOT to the installation directory if it is not found.
+#
+# Sets the following variables:
+#   SQLITE3_FOUND
+#   SQLITE3_INCLUDE_DIR
+#   SQLITE3_LIBRARY
+
+find_path(SQLITE3_INCLUDE_DIR sqlite3.h
+    HINTS "${SQLITE3_ROOT}" "$ENV{SQLITE3_ROOT}"
+    PATH_SUFFIXES include)
+
+find_library(SQLITE3_LIBRARY NAMES sqlite3
+    HINTS "${SQLITE3_ROOT}" "$ENV{SQLITE3_ROOT}"
+    PATH_SUFFIXES lib lib64)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(SQLite3
+    REQUIRED_VARS SQLITE3_LIBRARY SQLITE3_INCLUDE_DIR)
+
+mark_as_advanced(SQLITE3_INCLUDE_DIR SQLITE3_LIBRARY)
@@ -0,0 +1,22 @@
+# Finds the zstd compression library.
+#
+# Set ZSTD_ROOT to the installation directory if it is not found.
+#
+# Sets the following variables:
+#   ZSTD_FOUND
+#   ZSTD_INCLUDE_DIR
+#   ZSTD_LIBRARY
+
+find_path(ZSTD_INCLUDE_DIR zstd.h
+    HINTS "${ZSTD_ROOT}" "$ENV{ZSTD_ROOT}"
+    PATH_SUFFIXES include)
+
+find_library(ZSTD_LIBRARY NAMES zstd zstd_static
+    HINTS "${ZSTD_ROOT}" "$ENV{ZSTD_ROOT}"
+    PATH_SUFFIXES lib lib64)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd
+    REQUIRED_VARS ZSTD_LIBRARY ZSTD_INCLUDE_DIR)
+
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
@@ -1,6 +1,7 @@
 #include <pxr/base/tf/stringUtils.h>
 #include <pxr/base/tf/staticTokens.h>
 
+#include <pxr/usd/ar/resolver.h>
 #include <pxr/usd/usd/stage.h>
 #include <pxr/usd/usdGeom/scope.h>
 #include <pxr/usd/usdGeom/primvarsAPI.h>
@@ -8,15 +9,26 @@
 #include <my_global.h>
 #include <my_sys.h>
 #include <mysql.h>
+#include <mysqld_error.h>
 
 #include <z85/z85.hpp>
 
+#include "compression.h"
+#include "histogram.h"
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <random>
 #include <string>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 PXR_NAMESPACE_USING_DIRECTIVE
@@ -32,6 +44,7 @@ constexpr auto DB_ENV_VAR = "USD_SQL_DB";
 constexpr auto TABLE_ENV_VAR = "USD_SQL_TABLE";
 constexpr auto USER_ENV_VAR = "USD_SQL_USER";
 constexpr auto PASSWORD_ENV_VAR = "USD_SQL_PASSWD";
+constexpr auto COMPRESSION_LEVEL_ENV_VAR = "USD_SQL_COMPRESSION_LEVEL";
 
 std::string get_env_var(
     const std::string& server_name, const std::string& env_var,
@@ -43,7 +56,8 @@ std::string get_env_var(
     return default_value;
 }
 
-std::string generate_stage(int i) {
+// Pads the layer documentation, so the layer is about size bytes large.
+std::string generate_stage(int i, size_t size) {
     auto stage = UsdStage::CreateInMemory(TfStringPrintf("%i.usda", i));
 
     auto scope = UsdGeomScope::Define(stage, SdfPath("/scope"));
@@ -51,6 +65,11 @@ std::string generate_stage(int i) {
     primvarsAPI.CreatePrimvar(_tokens->counter, SdfValueTypeNames->Int).Set(i);
     std::string ret;
     stage->GetRootLayer()->ExportToString(&ret);
+    if (ret.size() < size) {
+        stage->GetRootLayer()->SetDocumentation(
+            std::string(size - ret.size(), 'x'));
+        stage->GetRootLayer()->ExportToString(&ret);
+    }
     return ret;
 }
 
@@ -62,37 +81,224 @@ int get_counter(UsdStageRefPtr stage) {
     return ret;
 }
 
-bool insert_to_database(MYSQL* connection, const std::string& table_name, const std::string& path, const std::string& data) {
+bool run_query(MYSQL* connection, const std::string& query) {
+    return mysql_real_query(connection, query.c_str(), query.size()) == 0;
+}
+
+// Compresses the data before inserting it, if the level is above zero. The
+// old row is replaced in a single transaction, so threads writing the same
+// path never see each other's half finished writes.
+bool insert_to_database(MYSQL* connection, const std::string& table_name, const std::string& path, const std::string& raw_data, int compression_level) {
+    const auto data = compression_level > 0 ? compress(raw_data, compression_level) : raw_data;
     std::string tmp;
     tmp.reserve(1024);
     std::stringstream query_delete;
     query_delete << "DELETE FROM `" << table_name << "` WHERE `path`=\"" << path << "\";";
     const auto query_delete_str = query_delete.str();
-    auto query_ret = mysql_real_query(connection, query_delete_str.c_str(), query_delete_str.size());
-    if (query_ret != 0) {
-        std::cerr << "Error executing delete query\n";
-    }
     std::stringstream query(tmp);
     query << "INSERT INTO `" << table_name
           << "` (`path`, `data`) VALUES (\"" << path
           << "\", _binary 0x";
     query << std::hex << std::setfill('0') << std::uppercase;
     for (auto c : data) {
-        query << std::setw(2) << static_cast<int>(c);
+        query << std::setw(2) << static_cast<int>(static_cast<unsigned char>(c));
     }
     query << ");";
 
     const auto query_str = query.str();
-    query_ret = mysql_real_query(connection, query_str.c_str(), query_str.size());
-    return query_ret == 0;
+    // Concurrent writes of a missing path can deadlock on the gap locks of
+    // the delete, the server then rolls one of them back.
+    for (auto attempt = 0; attempt < 3; ++attempt) {
+        if (run_query(connection, "START TRANSACTION") &&
+            run_query(connection, query_delete_str) &&
+            run_query(connection, query_str) &&
+            run_query(connection, "COMMIT")) {
+            return true;
+        }
+        const auto error = mysql_errno(connection);
+        run_query(connection, "ROLLBACK");
+        if (error != ER_LOCK_DEADLOCK && error != ER_LOCK_WAIT_TIMEOUT) {
+            std::cerr << "Error writing " << path << ": " << error << "\n";
+            return false;
+        }
+    }
+    return false;
+}
+
+using clock_type = std::chrono::steady_clock;
+
+enum Operation {
+    OPERATION_RESOLVE,
+    OPERATION_TIMESTAMP,
+    OPERATION_OPEN,
+    OPERATION_WRITE,
+    OPERATION_STAGE_OPEN,
+    OPERATION_RELOAD,
+    OPERATION_COUNT
+};
+
+constexpr const char* OPERATION_NAMES[OPERATION_COUNT] = {
+    "resolve", "timestamp", "open", "write", "stage open", "reload"};
+
+struct Options {
+    size_t num_threads = 6;
+    size_t num_assets = 1;
+    size_t num_operations = 2048;
+    size_t min_size = 0;
+    size_t max_size = 0;
+    unsigned int read_weight = 0;
+    unsigned int write_weight = 1;
+    unsigned int reload_weight = 1;
+    bool private_assets = true;
+    unsigned int seed = 1;
+};
+
+void print_usage(const char* name) {
+    std::cerr
+        << "Usage: " << name << " [options]\n"
+        << "  --threads N        Number of threads. Default is 6.\n"
+        << "  --assets N         Number of assets, per thread with --private.\n"
+        << "                     Default is 1.\n"
+        << "  --operations N     Operations per thread. Default is 2048.\n"
+        << "  --min-size BYTES   Smallest asset. Default is the size of an\n"
+        << "                     empty layer.\n"
+        << "  --max-size BYTES   Largest asset, sizes are spread\n"
+        << "                     logarithmically in between. Default is\n"
+        << "                     --min-size.\n"
+        << "  --mix R:W:L        Weights of reads through the resolver,\n"
+        << "                     writes and stage reloads. Default is 0:1:1.\n"
+        << "  --shared           All threads use the same assets.\n"
+        << "  --private          Each thread uses its own assets, and checks\n"
+        << "                     the reloaded data. This is the default.\n"
+        << "  --seed N           Seed for picking sizes and operations.\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (auto i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--shared") {
+            options.private_assets = false;
+            continue;
+        } else if (arg == "--private") {
+            options.private_assets = true;
+            continue;
+        }
+        if (i + 1 == argc) { return false; }
+        const char* value = argv[++i];
+        if (arg == "--threads") {
+            options.num_threads = strtoul(value, nullptr, 10);
+        } else if (arg == "--assets") {
+            options.num_assets = strtoul(value, nullptr, 10);
+        } else if (arg == "--operations") {
+            options.num_operations = strtoul(value, nullptr, 10);
+        } else if (arg == "--min-size") {
+            options.min_size = strtoul(value, nullptr, 10);
+        } else if (arg == "--max-size") {
+            options.max_size = strtoul(value, nullptr, 10);
+        } else if (arg == "--mix") {
+            if (sscanf(
+                    value, "%u:%u:%u", &options.read_weight,
+                    &options.write_weight, &options.reload_weight) != 3) {
+                return false;
+            }
+        } else if (arg == "--seed") {
+            options.seed =
+                static_cast<unsigned int>(strtoul(value, nullptr, 10));
+        } else {
+            return false;
+        }
+    }
+    options.max_size = std::max(options.min_size, options.max_size);
+    return options.num_threads > 0 && options.num_assets > 0 &&
+           options.read_weight + options.write_weight + options.reload_weight >
+               0;
 }
 
+// Sizes are spread logarithmically, so there are as many assets between 1KB
+// and 1MB as between 1MB and 1GB, like in a typical production.
+size_t pick_size(const Options& options, std::mt19937& generator) {
+    if (options.max_size == options.min_size) { return options.min_size; }
+    std::uniform_real_distribution<double> distribution(
+        std::log(static_cast<double>(std::max<size_t>(options.min_size, 1))),
+        std::log(static_cast<double>(options.max_size)));
+    return static_cast<size_t>(std::exp(distribution(generator)));
 }
 
-int main() {
+struct Asset {
+    std::string path;
+    std::string sql_path;
+    size_t size = 0;
+    // Last counter written, only checked for private assets.
+    std::atomic<int> counter{-1};
+};
+
+struct ThreadState {
+    std::vector<Histogram> histograms =
+        std::vector<Histogram>(OPERATION_COUNT);
+    std::unordered_map<size_t, UsdStageRefPtr> stages;
+    size_t errors = 0;
+};
+
+template <typename F>
+auto timed(Histogram& histogram, F&& f) -> decltype(f()) {
+    const auto begin = clock_type::now();
+    auto ret = f();
+    histogram.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - begin)
+            .count()));
+    return ret;
+}
+
+bool is_empty(const std::string& resolved_path) {
+    return resolved_path.empty();
+}
+
+#if AR_VERSION == 2
+bool is_empty(const ArResolvedPath& resolved_path) {
+    return resolved_path.IsEmpty();
+}
+#endif
+
+void print_report(
+    const std::vector<Histogram>& histograms, double elapsed_seconds) {
+    std::cout << std::fixed << std::setprecision(1) << std::left
+              << std::setw(12) << "operation" << std::right << std::setw(10)
+              << "count" << std::setw(12) << "ops/s" << std::setw(12)
+              << "mean us" << std::setw(12) << "p50 us" << std::setw(12)
+              << "p99 us" << std::setw(12) << "p999 us" << std::setw(12)
+              << "max us" << "\n";
+    for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+        const auto& histogram = histograms[i];
+        if (histogram.count() == 0) { continue; }
+        std::cout << std::left << std::setw(12) << OPERATION_NAMES[i]
+                  << std::right << std::setw(10) << histogram.count()
+                  << std::setw(12) << histogram.count() / elapsed_seconds
+                  << std::setw(12) << histogram.mean() / 1000.0
+                  << std::setw(12) << histogram.percentile(0.5) / 1000.0
+                  << std::setw(12) << histogram.percentile(0.99) / 1000.0
+                  << std::setw(12) << histogram.percentile(0.999) / 1000.0
+                  << std::setw(12) << histogram.max() / 1000.0 << "\n";
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
     my_init();
 
-    const std::string server_name = getenv(HOST_ENV_VAR);
+    const auto* host = getenv(HOST_ENV_VAR);
+    if (host == nullptr) {
+        std::cerr << "$" << HOST_ENV_VAR << " is not defined!\n";
+        return 1;
+    }
+    const std::string server_name = host;
     const auto table_name = get_env_var(server_name, TABLE_ENV_VAR, "usd");
     const auto server_user = get_env_var(server_name, USER_ENV_VAR, "root");
     const auto compacted_default_pass =
@@ -103,6 +309,8 @@ int main() {
     const auto server_db = get_env_var(server_name, DB_ENV_VAR, "test");
     const auto server_port = static_cast<unsigned int>(
         atoi(get_env_var(server_name, PORT_ENV_VAR, "3306").c_str()));
+    const auto compression_level =
+        atoi(get_env_var(server_name, COMPRESSION_LEVEL_ENV_VAR, "0").c_str());
 
     auto get_connection = [&] () -> MYSQL* {
         MYSQL* ret = mysql_init(nullptr);
@@ -118,55 +326,177 @@ int main() {
         return ret;
     };
 
-    constexpr size_t num_threads = 6;
-    constexpr size_t num_tests = 2048;
-
+    const auto num_threads = options.num_threads;
     std::vector<MYSQL*> connections;
     connections.reserve(num_threads);
     for (size_t i = 0; i < num_threads; ++i) {
         auto* conn = get_connection();
-        if (conn != nullptr) {
-            connections.push_back(conn);
+        if (conn == nullptr) {
+            std::cerr << "Error connecting to " << server_name << "!\n";
+            for (auto* opened : connections) { mysql_close(opened); }
+            return 1;
         }
+        connections.push_back(conn);
     }
 
+    // With private assets, thread t uses the assets starting at
+    // t * num_assets.
+    std::vector<Asset> assets(
+        options.private_assets ? options.num_assets * num_threads
+                               : options.num_assets);
+    std::mt19937 size_generator(options.seed);
+    for (size_t i = 0; i < assets.size(); ++i) {
+        assets[i].path = TfStringPrintf("/path%zu.usda", i);
+        assets[i].sql_path = TfStringPrintf("sql:///path%zu.usda", i);
+        assets[i].size = pick_size(options, size_generator);
+    }
+
+    std::cout << "threads: " << num_threads << ", assets: " << assets.size()
+              << (options.private_assets ? " private" : " shared")
+              << ", sizes: " << options.min_size << "-" << options.max_size
+              << " bytes, mix: " << options.read_weight << ":"
+              << options.write_weight << ":" << options.reload_weight
+              << ", operations per thread: " << options.num_operations
+              << "\n";
+
     std::atomic<int> counter;
     counter.store(0);
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::vector<ThreadState> states(num_threads);
 
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads);
-    auto thread_fun = [&] (MYSQL* conn) {
-
-        const auto id = counter.fetch_add(1);
-        const auto path = TfStringPrintf("/path%i.usda", id);
-        auto c = counter.fetch_add(1);
-        if (!insert_to_database(conn, table_name, path, generate_stage(c))) {
-            std::cerr << "Error inserting into the database!\n";
-            return;
+    auto thread_fun = [&] (size_t thread_index) {
+        auto* conn = connections[thread_index];
+        auto& state = states[thread_index];
+        const auto first_asset =
+            options.private_assets ? thread_index * options.num_assets : 0;
+        std::mt19937 generator(
+            options.seed + static_cast<unsigned int>(thread_index) + 1);
+        std::uniform_int_distribution<size_t> asset_distribution(
+            first_asset, first_asset + options.num_assets - 1);
+        std::uniform_int_distribution<unsigned int> operation_distribution(
+            0,
+            options.read_weight + options.write_weight +
+                options.reload_weight - 1);
+
+        const auto write = [&] (Asset& asset) {
+            const auto c = counter.fetch_add(1);
+            const auto data = generate_stage(c, asset.size);
+            if (!timed(state.histograms[OPERATION_WRITE], [&]() {
+                    return insert_to_database(
+                        conn, table_name, asset.path, data,
+                        compression_level);
+                })) {
+                std::cerr << "Error inserting into the database!\n";
+                ++state.errors;
+                return;
+            }
+            asset.counter = c;
+        };
+
+        // Every thread uploads its share of the assets before the timing
+        // starts.
+        for (size_t i = thread_index; i < assets.size(); i += num_threads) {
+            write(assets[i]);
         }
-        const auto sqlPath = TfStringPrintf("sql:///path%i.usda", id);
-        auto stage = UsdStage::Open(sqlPath);
-        for (size_t t = 0; t < num_tests; t += 1) {
-            c = counter.fetch_add(1);
-            insert_to_database(conn, table_name, path, generate_stage(c));
-            stage->Reload();
-            const auto c_new = get_counter(stage);
-            if (c != c_new) {
-                std::cerr << path << " incorrect counter " << c << " vs " << c_new << "\n";
+        for (auto& histogram : state.histograms) { histogram.reset(); }
+        ready.fetch_add(1);
+        while (!start.load()) { std::this_thread::yield(); }
+
+        auto& resolver = ArGetResolver();
+        for (size_t t = 0; t < options.num_operations; ++t) {
+            const auto asset_index = asset_distribution(generator);
+            auto& asset = assets[asset_index];
+            auto operation = operation_distribution(generator);
+            if (operation < options.read_weight) {
+                const auto resolved =
+                    timed(state.histograms[OPERATION_RESOLVE], [&]() {
+                        return resolver.Resolve(asset.sql_path);
+                    });
+                if (is_empty(resolved)) {
+                    std::cerr << asset.sql_path << " failed to resolve\n";
+                    ++state.errors;
+                    continue;
+                }
+                timed(state.histograms[OPERATION_TIMESTAMP], [&]() {
+                    return resolver.GetModificationTimestamp(
+                        asset.sql_path, resolved);
+                });
+                const auto opened =
+                    timed(state.histograms[OPERATION_OPEN], [&]() {
+                        return resolver.OpenAsset(resolved);
+                    });
+                if (opened == nullptr) {
+                    std::cerr << asset.sql_path << " failed to open\n";
+                    ++state.errors;
+                }
+                continue;
+            }
+            operation -= options.read_weight;
+            if (operation < options.write_weight) {
+                write(asset);
+                continue;
+            }
+
+            auto& stage = state.stages[asset_index];
+            if (stage == nullptr) {
+                stage = timed(state.histograms[OPERATION_STAGE_OPEN], [&]() {
+                    return UsdStage::Open(asset.sql_path);
+                });
+                if (stage == nullptr) {
+                    std::cerr << asset.sql_path << " failed to open stage\n";
+                    ++state.errors;
+                    state.stages.erase(asset_index);
+                    continue;
+                }
+            } else {
+                timed(state.histograms[OPERATION_RELOAD], [&]() {
+                    stage->Reload();
+                    return true;
+                });
+            }
+            // Other threads might write shared assets meanwhile.
+            if (options.private_assets) {
+                const auto c_new = get_counter(stage);
+                if (asset.counter != c_new) {
+                    std::cerr << asset.path << " incorrect counter "
+                              << asset.counter.load() << " vs " << c_new
+                              << "\n";
+                    ++state.errors;
+                }
             }
         }
     };
-    for (auto* conn : connections) {
-        threads.emplace_back(thread_fun, conn);
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back(thread_fun, i);
     }
 
+    while (ready.load() != num_threads) { std::this_thread::yield(); }
+    const auto begin = clock_type::now();
+    start.store(true);
     for (auto& thread : threads) {
         thread.join();
     }
+    const std::chrono::duration<double> elapsed = clock_type::now() - begin;
 
     for (auto* conn : connections) {
         mysql_close(conn);
     }
 
-    return 0;
+    std::vector<Histogram> histograms(OPERATION_COUNT);
+    size_t errors = 0;
+    for (const auto& state : states) {
+        for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+            histograms[i].merge(state.histograms[i]);
+        }
+        errors += state.errors;
+    }
+    std::cout << "elapsed: " << elapsed.count() << " s, errors: " << errors
+              << "\n";
+    print_report(histograms, elapsed.count());
+
+    return errors == 0 ? 0 : 1;
 }